@@ -1,62 +1,395 @@
 // tennis_tracker.cpp
 // Beginner-style interactive tennis match tracker (enforces tiebreak serve 1-2-2)
-// Build: g++ -std=c++17 -O0 -g tennis_tracker.cpp -o tennis_tracker
+// Build: g++ -std=c++17 -O0 -g -pthread tennis_tracker.cpp -o tennis_tracker
 
 #include <iostream>
-#include <iomanip>
 #include <string>
 #include <vector>
-#include <fstream>
-#include <sstream>
 #include <ctime>
 #include <cstdlib>
+#include <cstdio>
+#include <charconv>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <unordered_map>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <csignal>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define HAVE_IO_URING 1
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#define HAVE_EPOLL 1
+#endif
+#if defined(TENNIS_BENCH) && defined(__linux__) && __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#define HAVE_PERF_EVENTS 1
+#endif
 
 using namespace std;
 
-// =============== Small helpers ===============
+// =============== Number formatting ===============
+// Allocation-free formatting into caller-provided buffers: integers via
+// to_chars, percentages in integer fixed-point. Every stats view and
+// exporter goes through these (usually via the OutBuf operators below), so
+// none of them touch iostream formatting or the locale.
 
-static string now_date_time_string() {
-    time_t t = time(nullptr);
-    tm *lt = localtime(&t);
-    char buf[64];
-    strftime(buf, sizeof(buf), "%Y-%m-%d_%H-%M-%S", lt);
-    return string(buf);
+static const int FORMAT_BUF = 32;   // enough for any of the functions below
+
+static int format_int(char* out, long long v) {
+    return (int)(to_chars(out, out + 24, v).ptr - out);
 }
 
-static string safe_percent(int num, int den) {
-    if (den <= 0) return "--";
-    double p = 100.0 * (double)num / (double)den;
-    stringstream ss;
-    ss << fixed << setprecision(1) << p << "%";
-    return ss.str();
+// "num/den"
+static int format_ratio(char* out, int num, int den) {
+    int n = format_int(out, num);
+    out[n++] = '/';
+    return n + format_int(out + n, den);
 }
 
-static string safe_ratio(int num, int den) {
-    stringstream ss;
-    ss << num << "/" << den;
-    return ss.str();
+// num/den as "12.3%" using integer fixed-point tenths. Exact ties round to
+// even, which matches what printf("%.1f") did for these values.
+// Returns the length; "--" if den<=0.
+static int format_percent(char* out, int num, int den) {
+    if (den <= 0) { out[0]='-'; out[1]='-'; return 2; }
+    long long twice = 2000LL * num, div = 2LL * den;
+    long long tenths = twice / div, rem = twice % div;
+    if (rem > den || (rem == den && (tenths & 1))) tenths++;
+    int n = format_int(out, tenths / 10);
+    out[n++] = '.';
+    out[n++] = (char)('0' + (int)(tenths % 10));
+    out[n++] = '%';
+    return n;
 }
 
-static string left_pad(const string& s, int width) {
-    if ((int)s.size() >= width) return s;
-    return string(width - (int)s.size(), ' ') + s;
+// v with `decimals` digits after the point; "--" if it does not fit.
+static int format_fixed(char* out, double v, int decimals) {
+    to_chars_result r = to_chars(out, out + FORMAT_BUF, v, chars_format::fixed, decimals);
+    if (r.ec != errc()) { out[0]='-'; out[1]='-'; return 2; }
+    return (int)(r.ptr - out);
 }
 
-static string right_pad(const string& s, int width) {
-    if ((int)s.size() >= width) return s;
-    return s + string(width - (int)s.size(), ' ');
+// =============== Lock-free queues ===============
+// Single-producer/single-consumer ring: one thread pushes, one other thread
+// pops, and neither ever waits for the other. push() fails when the ring is
+// full and pop() when it is empty; what to do then is up to the caller.
+
+template <class T, size_t N>
+class SpscRing {
+    static_assert((N & (N-1)) == 0, "ring size must be a power of two");
+public:
+    bool push(T v) {
+        uint64_t h = head_.load(memory_order_relaxed);
+        if (h - tail_.load(memory_order_acquire) == N) return false;
+        slots_[h & (N-1)] = std::move(v);
+        head_.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool pop(T& out) {
+        uint64_t t = tail_.load(memory_order_relaxed);
+        if (t == head_.load(memory_order_acquire)) return false;
+        out = std::move(slots_[t & (N-1)]);
+        tail_.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    // Consumer side: hands f everything queued so far.
+    template <class F> void drain(F f) {
+        uint64_t t = tail_.load(memory_order_relaxed);
+        uint64_t h = head_.load(memory_order_acquire);
+        for (; t != h; t++) f(slots_[t & (N-1)]);
+        tail_.store(t, memory_order_release);
+    }
+
+    bool empty() const { return head_.load(memory_order_acquire) == tail_.load(memory_order_acquire); }
+
+private:
+    alignas(64) atomic<uint64_t> head_{0};
+    alignas(64) atomic<uint64_t> tail_{0};
+    T slots_[N];
+};
+
+// =============== Instrumentation ===============
+// Where a point's time goes. Each phase gets a log-bucketed (HDR-style)
+// latency histogram: 16 linear sub-buckets per power of two, so any value is
+// within about 6% of its bucket at every scale from nanoseconds to minutes.
+// The phases are timed on the main thread only.
+
+enum Phase { PHASE_INPUT, PHASE_STATS, PHASE_SCORING, PHASE_HISTORY, PHASE_RENDER, PHASE_COUNT };
+
+static const char* const PHASE_NAMES[PHASE_COUNT] = { "input", "stats", "scoring", "history", "render" };
+
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB = 1 << SUB_BITS;
+    static const int BUCKETS = 41 << SUB_BITS;   // up to 2^44 ns, about 4.9 hours
+
+    void record(uint64_t ns) {
+        counts_[bucket_of(ns)]++;
+        total_++;
+        if (ns > max_) max_ = ns;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t max() const { return max_; }
+
+    // Highest value in the bucket holding the q-quantile (q in [0,1]).
+    uint64_t percentile(double q) const {
+        if (total_ == 0) return 0;
+        uint64_t want = (uint64_t)(q * (double)(total_ - 1)), seen = 0;
+        for (int i=0;i<BUCKETS;i++) {
+            seen += counts_[i];
+            if (seen > want) return min(bucket_top(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static int bucket_of(uint64_t v) {
+        if (v < (uint64_t)SUB) return (int)v;
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - SUB_BITS;
+        int idx = ((shift + 1) << SUB_BITS) + (int)((v >> shift) & (SUB - 1));
+        return idx < BUCKETS ? idx : BUCKETS - 1;
+    }
+    static uint64_t bucket_top(int idx) {
+        if (idx < SUB) return (uint64_t)idx;
+        int shift = (idx >> SUB_BITS) - 1;
+        return (((uint64_t)(SUB + (idx & (SUB - 1))) + 1) << shift) - 1;
+    }
+
+    uint64_t counts_[BUCKETS] = {};
+    uint64_t total_ = 0, max_ = 0;
+};
+
+static LatencyHistogram phase_histograms[PHASE_COUNT];
+
+// Allocation accounting. The benchmark build (TENNIS_BENCH) and the
+// allocation-stats build (TENNIS_ALLOC_STATS) replace global operator new to
+// count allocations. The stats build also charges each one to the current
+// site: the phase being timed, or one of the finer sites below, set with
+// AllocSiteScope.
+enum AllocSite { SITE_OTHER = PHASE_COUNT, SITE_EVENT_CHAIN, SITE_LOG, SITE_EXPORT, SITE_COUNT };
+
+static const char* const SITE_NAMES[SITE_COUNT] = {
+    "input", "stats", "scoring", "history", "render", "other", "event_chain", "log", "export" };
+
+#if defined(TENNIS_BENCH) || defined(TENNIS_ALLOC_STATS)
+#define HAVE_ALLOC_COUNTING 1
+
+static atomic<long long> alloc_count_total(0), alloc_bytes_total(0);
+
+#ifdef TENNIS_ALLOC_STATS
+static atomic<long long> site_alloc_count[SITE_COUNT], site_alloc_bytes[SITE_COUNT];
+static thread_local int current_alloc_site = SITE_OTHER;
+#endif
+
+// Our delete pairs with our new; GCC cannot see that once they are inlined.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+static void count_alloc(size_t n) {
+    alloc_count_total.fetch_add(1, memory_order_relaxed);
+    alloc_bytes_total.fetch_add((long long)n, memory_order_relaxed);
+#ifdef TENNIS_ALLOC_STATS
+    site_alloc_count[current_alloc_site].fetch_add(1, memory_order_relaxed);
+    site_alloc_bytes[current_alloc_site].fetch_add((long long)n, memory_order_relaxed);
+#endif
 }
 
-// Optional color (safe fallback)
-static bool use_color() {
-    const char* term = getenv("TERM");
-    if (!term) return false;
-    string t(term);
-    return (t.find("xterm") != string::npos || t.find("color") != string::npos);
+void* operator new(size_t n) {
+    count_alloc(n);
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
 }
-static string green_dot() {
-    if (use_color()) return "\033[1;32m●\033[0m";
-    return "●";
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// Cache-line aligned types (MatchState) come through here.
+void* operator new(size_t n, align_val_t al) {
+    count_alloc(n);
+    size_t a = (size_t)al;
+    if (void* p = aligned_alloc(a, (n + a - 1) / a * a)) return p;
+    throw bad_alloc();
+}
+void operator delete(void* p, align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { free(p); }
+#endif
+
+#ifdef TENNIS_ALLOC_STATS
+class AllocSiteScope {
+public:
+    explicit AllocSiteScope(int site) : saved_(current_alloc_site) { current_alloc_site = site; }
+    ~AllocSiteScope() { current_alloc_site = saved_; }
+    AllocSiteScope(const AllocSiteScope&) = delete;
+    AllocSiteScope& operator=(const AllocSiteScope&) = delete;
+private:
+    int saved_;
+};
+#else
+struct AllocSiteScope { explicit AllocSiteScope(int) {} };
+#endif
+
+static uint64_t now_ns() {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Optional Chrome/Perfetto trace (--trace FILE). Every thread that emits a
+// span owns an SpscRing; the trace writer thread is the only consumer, so
+// pushing is two relaxed/acquire loads and one release store. A full ring
+// drops the span and counts it rather than blocking the caller.
+// Span names must be string literals: only the pointer is stored.
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+};
+
+class TraceRing : public SpscRing<TraceEvent, 4096> {
+public:
+    explicit TraceRing(int tid) : tid_(tid) {}
+    int tid() const { return tid_; }
+private:
+    int tid_;
+};
+
+static bool trace_enabled = false;      // set once before any thread starts
+static atomic<uint64_t> trace_dropped{0};
+static mutex trace_rings_mutex;
+static vector<unique_ptr<TraceRing>> trace_rings;
+
+static TraceRing& this_thread_trace_ring() {
+    static thread_local TraceRing* ring = nullptr;
+    if (!ring) {
+        lock_guard<mutex> lk(trace_rings_mutex);
+        trace_rings.push_back(make_unique<TraceRing>((int)trace_rings.size() + 1));
+        ring = trace_rings.back().get();
+    }
+    return *ring;
+}
+
+static void trace_emit(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    if (!this_thread_trace_ring().push(TraceEvent{name, start_ns, end_ns - start_ns}))
+        trace_dropped.fetch_add(1, memory_order_relaxed);
+}
+
+// A trace span with no histogram behind it (whole points, export jobs).
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : name_(name), start_(trace_enabled ? now_ns() : 0) {}
+    ~TraceSpan() { if (trace_enabled) trace_emit(name_, start_, now_ns()); }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+private:
+    const char* name_;
+    uint64_t start_;
+};
+
+// Times its own lifetime into the phase's histogram (and the trace, when on),
+// and charges the allocations made meanwhile to the phase.
+class PhaseScope {
+public:
+    explicit PhaseScope(Phase p) : phase_(p), site_(p), start_(now_ns()) {}
+    ~PhaseScope() {
+        uint64_t end = now_ns();
+        phase_histograms[phase_].record(end - start_);
+        if (trace_enabled) trace_emit(PHASE_NAMES[phase_], start_, end);
+    }
+    PhaseScope(const PhaseScope&) = delete;
+    PhaseScope& operator=(const PhaseScope&) = delete;
+private:
+    Phase phase_;
+    AllocSiteScope site_;
+    uint64_t start_;
+};
+
+// =============== Output buffer ===============
+// Exports are rendered into one growable buffer and written with a single
+// fwrite, instead of formatting field by field through ofstream.
+
+struct OutBuf {
+    string data;
+};
+
+struct Percent { int num, den; };
+struct Ratio { int num, den; };
+struct Fixed { double v; int decimals; };
+
+static OutBuf& operator<<(OutBuf& b, const string& s) { b.data.append(s); return b; }
+static OutBuf& operator<<(OutBuf& b, const char* s) { b.data.append(s); return b; }
+static OutBuf& operator<<(OutBuf& b, char c) { b.data.push_back(c); return b; }
+template <class T, class = typename enable_if<is_integral<T>::value>::type>
+static OutBuf& operator<<(OutBuf& b, T v) {
+    char buf[FORMAT_BUF];
+    char* end = to_chars(buf, buf + sizeof(buf), v).ptr;
+    b.data.append(buf, end - buf);
+    return b;
+}
+static OutBuf& operator<<(OutBuf& b, Percent p) {
+    char buf[FORMAT_BUF];
+    b.data.append(buf, format_percent(buf, p.num, p.den));
+    return b;
+}
+static OutBuf& operator<<(OutBuf& b, Ratio r) {
+    char buf[FORMAT_BUF];
+    b.data.append(buf, format_ratio(buf, r.num, r.den));
+    return b;
+}
+static OutBuf& operator<<(OutBuf& b, Fixed f) {
+    char buf[FORMAT_BUF];
+    b.data.append(buf, format_fixed(buf, f.v, f.decimals));
+    return b;
+}
+
+// Pads whatever was appended since `start` with spaces up to `width`.
+static void pad_from(OutBuf& b, size_t start, int width) {
+    size_t used = b.data.size() - start;
+    if ((int)used < width) b.data.append(width - used, ' ');
+}
+
+static void write_stdout(const OutBuf& b) {
+    cout.write(b.data.data(), (streamsize)b.data.size());
+}
+
+// Per-thread scratch buffer, cleared but never shrunk, so repeated exports
+// reuse the same allocation.
+static OutBuf& scratch_buffer() {
+    static thread_local OutBuf b;
+    b.data.clear();
+    return b;
 }
 
 // =============== Data ===============
@@ -72,6 +405,15 @@ struct FormatConfig {
     int deciding_tb_points;    // 10, win by 2
 };
 
+// Formats 1-3 as offered by the format menu.
+static FormatConfig get_format_by_choice(int c) {
+    FormatConfig fc;
+    if (c==1) { fc.games_to_win_set=6; fc.tiebreak_at_games=6; fc.set_tiebreak_points=7; fc.deciding=DECIDING_REGULAR; fc.deciding_tb_points=10; }
+    else if (c==2){ fc.games_to_win_set=6; fc.tiebreak_at_games=6; fc.set_tiebreak_points=7; fc.deciding=DECIDING_TB10; fc.deciding_tb_points=10; }
+    else          { fc.games_to_win_set=4; fc.tiebreak_at_games=4; fc.set_tiebreak_points=7; fc.deciding=DECIDING_REGULAR; fc.deciding_tb_points=10; }
+    return fc;
+}
+
 struct PlayerStats {
     // Serve attempts
     int first_serves_attempted=0, first_serves_in=0;
@@ -92,7 +434,35 @@ struct PlayerStats {
     int break_points_won=0, break_points_total=0;
     // Totals
     int points_won=0, points_played=0;
+    // Importance-weighted points (see point_importance), in 1/IMPORTANCE_SCALE
+    int clutch_weight_won=0, clutch_weight_played=0;
+};
+
+static const int IMPORTANCE_SCALE = 10000;
+
+// PlayerStats counters in CSV column order; shared by the exporters and the
+// archive loader so the two can never disagree.
+static int PlayerStats::* const STAT_FIELDS[] = {
+    &PlayerStats::first_serves_in, &PlayerStats::first_serves_attempted, &PlayerStats::points_won_on_first_serve,
+    &PlayerStats::second_serves_in, &PlayerStats::second_serves_attempted, &PlayerStats::points_won_on_second_serve,
+    &PlayerStats::aces_first, &PlayerStats::aces_second, &PlayerStats::service_winners_first, &PlayerStats::service_winners_second,
+    &PlayerStats::double_faults, &PlayerStats::return_points_won_vs_first, &PlayerStats::return_points_won_vs_second,
+    &PlayerStats::return_winners, &PlayerStats::return_unforced_errors, &PlayerStats::return_forced_errors,
+    &PlayerStats::rally_winners, &PlayerStats::unforced_errors, &PlayerStats::forced_errors_drawn,
+    &PlayerStats::net_points_won, &PlayerStats::net_points_total, &PlayerStats::break_points_won, &PlayerStats::break_points_total,
+    &PlayerStats::points_won, &PlayerStats::points_played,
+    &PlayerStats::clutch_weight_won, &PlayerStats::clutch_weight_played,
 };
+static const int STAT_FIELD_COUNT = (int)(sizeof(STAT_FIELDS)/sizeof(STAT_FIELDS[0]));
+// Their names, as in the CSV headers
+static const char* const STAT_FIELD_NAMES[] = {
+    "FirstServIn", "FirstServAtt", "FirstPtsWon", "SecondServIn", "SecondServAtt", "SecondPtsWon",
+    "Aces1", "Aces2", "SrvW1", "SrvW2", "DF", "RetWonV1", "RetWonV2", "RetW", "RetUE", "RetFE",
+    "RallyW", "UE", "FEdrawn", "NetWon", "NetTot", "BPWon", "BPTot", "PtsWon", "PtsPlayed",
+    "ClutchWon", "ClutchPlayed",
+};
+static_assert(sizeof(STAT_FIELD_NAMES)/sizeof(STAT_FIELD_NAMES[0]) == sizeof(STAT_FIELDS)/sizeof(STAT_FIELDS[0]),
+              "every stat field needs a name");
 
 struct PointLogEntry {
     int set_index=0;
@@ -111,6 +481,9 @@ struct PointLogEntry {
     bool was_game_point=false;
     bool was_set_point=false;
     bool was_match_point=false;
+
+    // Swing in match-win probability between winning and losing this point
+    double importance=0;
 };
 
 struct SetScore {
@@ -122,20 +495,12 @@ struct SetScore {
     int tb_points_p2=0;
 };
 
-struct MatchState {
-    // Meta
-    string player1_name, player2_name, location;
-
-    // Format
-    FormatConfig format;
-    int best_of_sets=3;
+// The fields every point reads and writes, kept together in one cache line
+// at the start of each MatchState; names, vectors, stats and the log follow.
+// Courts on the server are separate MatchStates, so their cores are not
+// adjacent to each other; the bench's court sweeps show what that costs.
+struct alignas(64) ScoreCore {
     int sets_to_win=2;
-
-    // Sets and per-set stats
-    vector<SetScore> sets;
-    vector<PlayerStats> per_set_stats_p1;
-    vector<PlayerStats> per_set_stats_p2;
-
     int current_set_index=0;
 
     // Regular game points (0.. = 0/15/30/40/deuce+)
@@ -154,175 +519,400 @@ struct MatchState {
     // Sets won
     int sets_won_p1=0, sets_won_p2=0;
 
-    // Match totals
-    PlayerStats match_stats_p1, match_stats_p2;
-
-    // in struct MatchState
     ServeType current_point_serve = SERVE_NONE;
+};
+static_assert(sizeof(ScoreCore) == 64, "ScoreCore should fill exactly one cache line");
 
+struct MatchState : ScoreCore {
+    // Meta
+    string player1_name, player2_name, location;
+
+    // Format
+    FormatConfig format;
+    int best_of_sets=3;
+
+    // Sets and per-set stats
+    vector<SetScore> sets;
+    vector<PlayerStats> per_set_stats_p1;
+    vector<PlayerStats> per_set_stats_p2;
+
+    // Match totals
+    PlayerStats match_stats_p1, match_stats_p2;
 
     // Log
     vector<PointLogEntry> log_entries;
+
+    // Bumped (from a global counter) whenever a point is recorded; undo
+    // restores the old value along with the old state, so equal revisions
+    // always mean equal stats. The stats view cache keys on it.
+    uint64_t revision = 0;
 };
 
+static uint64_t last_revision = 0;
+
 // =============== Globals for undo ===============
-static vector<MatchState> history_stack;
-static void push_history(const MatchState& st){ history_stack.push_back(st); }
-static bool pop_history(MatchState& st){ if(history_stack.empty()) return false; st=history_stack.back(); history_stack.pop_back(); return true; }
+// A point only changes the score core, the set in play (or appends a new
+// one), that set's stats and the match totals, and appends to the log. An
+// undo record holds just those, so it is a fixed size, costs no allocation
+// once the stack has grown, and does not copy the log or the names.
+struct UndoRecord {
+    ScoreCore core;
+    SetScore current_set;
+    PlayerStats set_stats_p1, set_stats_p2;
+    PlayerStats match_stats_p1, match_stats_p2;
+    uint32_t sets_size, log_size;
+    uint64_t revision;
+};
 
-// =============== Printing ===============
+static vector<UndoRecord> history_stack;
 
-static string tennis_point_to_string(int p) {
-    if (p <= 0) return "0";
-    if (p == 1) return "15";
-    if (p == 2) return "30";
-    if (p >= 3) return "40";
-    return "0";
+static void push_history(const MatchState& st){
+    PhaseScope ps(PHASE_HISTORY);
+    history_stack.emplace_back();
+    UndoRecord& u = history_stack.back();
+    u.core = st;
+    u.current_set = st.sets[st.current_set_index];
+    u.set_stats_p1 = st.per_set_stats_p1[st.current_set_index];
+    u.set_stats_p2 = st.per_set_stats_p2[st.current_set_index];
+    u.match_stats_p1 = st.match_stats_p1;
+    u.match_stats_p2 = st.match_stats_p2;
+    u.sets_size = (uint32_t)st.sets.size();
+    u.log_size = (uint32_t)st.log_entries.size();
+    u.revision = st.revision;
 }
 
-static void compute_tiebreak_server(MatchState& st) {
-    // Enforce 1–2–2 pattern:
-    // Points indexed from 0: 0:S, 1:O, 2:O, 3:S, 4:S, 5:O, 6:O, 7:S, ...
-    // So, server = tb_start_server if (i%4==0 or i%4==3), else opponent.
-    int total = st.tb_points_p1 + st.tb_points_p2; // points already played
-    int mod4 = total % 4;
-    int start = st.tb_start_server;
-    int opp = (start==0?1:0);
-    if (mod4==0 || mod4==3) st.current_server = start;
-    else st.current_server = opp;
+static bool pop_history(MatchState& st){
+    AllocSiteScope site(PHASE_HISTORY);
+    if(history_stack.empty()) return false;
+    const UndoRecord& u = history_stack.back();
+    static_cast<ScoreCore&>(st) = u.core;
+    st.sets.resize(u.sets_size);
+    st.per_set_stats_p1.resize(u.sets_size);
+    st.per_set_stats_p2.resize(u.sets_size);
+    st.sets[st.current_set_index] = u.current_set;
+    st.per_set_stats_p1[st.current_set_index] = u.set_stats_p1;
+    st.per_set_stats_p2[st.current_set_index] = u.set_stats_p2;
+    st.match_stats_p1 = u.match_stats_p1;
+    st.match_stats_p2 = u.match_stats_p2;
+    st.log_entries.resize(u.log_size);
+    st.revision = u.revision;
+    history_stack.pop_back();
+    return true;
+}
 
-    // Change ends every 6 points -> we just print a cue when needed (after last point),
-    // the user will see it before entering next point.
-    if (total>0 && total%6==0) {
-        cout << "\n--- Change ends (tiebreak, after " << total << " points) ---\n";
+// =============== Win probability ===============
+// Match-win probability from a Markov chain over point -> game -> tiebreak ->
+// set -> match, driven by each player's chance of winning a point on serve.
+// One WinProbModel holds the DP tables for a format and a (quantized) pair of
+// serve rates; it is filled completely when built, so a live update is a few
+// table lookups. Models are cached, and the rates move in coarse steps, so
+// most points reuse the previous model.
+
+static const double SERVE_RATE_PRIOR = 0.62;   // typical share of service points won
+static const int SERVE_RATE_PRIOR_POINTS = 20; // weight of the prior, in points
+static const int SERVE_RATE_STEPS = 200;       // rates are quantized to 1/200
+
+class WinProbModel {
+public:
+    // pa: P(player 1 wins a point on own serve), pb: same for player 2.
+    WinProbModel(const FormatConfig& f, int sets_to_win, double pa, double pb)
+        : f_(f), sets_to_win_(sets_to_win), pa_(pa), pb_(pb) {
+        games_dim_ = max(f_.games_to_win_set, f_.tiebreak_at_games) + 2;
+        set_tb_.assign(2 * f_.set_tiebreak_points * f_.set_tiebreak_points, -1.0);
+        dec_tb_.assign(2 * f_.deciding_tb_points * f_.deciding_tb_points, -1.0);
+        match_.assign((size_t)sets_to_win_ * sets_to_win_ * games_dim_ * games_dim_ * 2, -1.0);
+        for (int s=0;s<2;s++) {
+            double p = (s==0 ? pa_ : pb_);
+            for (int i=0;i<4;i++) for (int j=0;j<4;j++) hold_[s][i][j] = -1.0;
+            for (int i=3;i>=0;i--) for (int j=3;j>=0;j--) hold_[s][i][j] = game(p, s, i, j);
+        }
+        for (int srv=0;srv<2;srv++) {
+            tiebreak(set_tb_, f_.set_tiebreak_points, srv, 0, 0);
+            tiebreak(dec_tb_, f_.deciding_tb_points, srv, 0, 0);
+        }
+        int last = max(f_.games_to_win_set, f_.tiebreak_at_games);
+        for (int s1=0;s1<sets_to_win_;s1++) for (int s2=0;s2<sets_to_win_;s2++)
+            for (int g1=0;g1<=last;g1++) for (int g2=0;g2<=last;g2++)
+                for (int srv=0;srv<2;srv++)
+                    if (!set_won(g1, g2) && !set_won(g2, g1)) game_start(s1, s2, g1, g2, srv);
     }
-}
 
-static void print_scoreboard(const MatchState& st) {
-    string p1 = st.player1_name;
-    string p2 = st.player2_name;
+    // P(player 1 wins the match) from the live state.
+    double player1_wins(const MatchState& st) const { return with_points(st, 0, 0); }
 
-    // Serving dot before the server's name
-    string sdot = green_dot();
-    string name1 = (st.current_server==0 ? (sdot + " " + p1) : ("  " + p1));
-    string name2 = (st.current_server==1 ? (sdot + " " + p2) : ("  " + p2));
+    // P(win match | win next point) - P(win match | lose it); the same from
+    // either player's side.
+    double importance(const MatchState& st) const { return with_points(st, 1, 0) - with_points(st, 0, 1); }
 
-    int g1 = st.sets[st.current_set_index].games_player1;
-    int g2 = st.sets[st.current_set_index].games_player2;
+private:
+    // As player1_wins, with d1/d2 extra points credited in the current game
+    // or tiebreak.
+    double with_points(const MatchState& st, int d1, int d2) const {
+        if (st.sets_won_p1 >= sets_to_win_) return 1.0;
+        if (st.sets_won_p2 >= sets_to_win_) return 0.0;
+        int s1 = st.sets_won_p1, s2 = st.sets_won_p2;
+        if (st.in_match_tiebreak10) {
+            double t = tiebreak(dec_tb_, f_.deciding_tb_points, st.tb_start_server, st.tb_points_p1+d1, st.tb_points_p2+d2);
+            int next = 1 - st.tb_start_server;
+            return t * after_set(s1+1, s2, next) + (1-t) * after_set(s1, s2+1, next);
+        }
+        if (st.in_set_tiebreak) {
+            double t = tiebreak(set_tb_, f_.set_tiebreak_points, st.tb_start_server, st.tb_points_p1+d1, st.tb_points_p2+d2);
+            int next = 1 - st.tb_start_server;
+            return t * after_set(s1+1, s2, next) + (1-t) * after_set(s1, s2+1, next);
+        }
+        const SetScore& ss = st.sets[st.current_set_index];
+        int srv = st.current_server;
+        int i = (srv==0 ? st.game_points_p1 + d1 : st.game_points_p2 + d2);
+        int j = (srv==0 ? st.game_points_p2 + d2 : st.game_points_p1 + d1);
+        double h = game(srv==0 ? pa_ : pb_, srv, i, j);
+        double w = (srv==0 ? h : 1-h);
+        return w * after_game(s1, s2, ss.games_player1+1, ss.games_player2, 1-srv)
+             + (1-w) * after_game(s1, s2, ss.games_player1, ss.games_player2+1, 1-srv);
+    }
 
-    string pts1, pts2;
-    if (st.in_set_tiebreak || st.in_match_tiebreak10) {
-        pts1 = to_string(st.tb_points_p1);
-        pts2 = to_string(st.tb_points_p2);
-    } else {
-        if (st.game_points_p1 >= 3 && st.game_points_p2 >= 3) {
-            if (st.game_points_p1 == st.game_points_p2) { pts1="40"; pts2="40"; }
-            else if (st.game_points_p1 == st.game_points_p2 + 1) { pts1="Ad"; pts2=""; }
-            else if (st.game_points_p2 == st.game_points_p1 + 1) { pts1=""; pts2="Ad"; }
-            else { pts1=tennis_point_to_string(st.game_points_p1); pts2=tennis_point_to_string(st.game_points_p2); }
+    // P(player 1 wins a point served by `server`)
+    double point_for_p1(int server) const { return server==0 ? pa_ : 1.0 - pb_; }
+
+    bool set_won(int g_you, int g_opp) const {
+        return g_you >= f_.games_to_win_set && g_you - g_opp >= 2;
+    }
+
+    // P(server wins the game) from i server points, j receiver points.
+    // From deuce on it is closed form: p^2 / (p^2 + q^2).
+    double game(double p, int s, int i, int j) const {
+        if (i >= 4 && i - j >= 2) return 1.0;
+        if (j >= 4 && j - i >= 2) return 0.0;
+        double q = 1.0 - p;
+        if (i >= 3 && j >= 3) {
+            double deuce = p*p / (p*p + q*q);
+            if (i == j) return deuce;
+            return i > j ? p + q*deuce : p*deuce;
+        }
+        if (hold_[s][i][j] >= 0) return hold_[s][i][j];
+        return p * game(p, s, i+1, j) + q * game(p, s, i, j+1);
+    }
+
+    // P(player 1 wins a tiebreak to `target`) from a-b, `start` serving first
+    // (1-2-2 rotation). Level at target-1 or beyond, the next two points are
+    // one serve each, so it is closed form again.
+    double tiebreak(vector<double>& memo, int target, int start, int a, int b) const {
+        if (a >= target && a - b >= 2) return 1.0;
+        if (b >= target && b - a >= 2) return 0.0;
+        int n = a + b;
+        int server = (n % 4 == 0 || n % 4 == 3) ? start : 1 - start;
+        double p = point_for_p1(server);
+        if (a >= target-1 && b >= target-1) {
+            double x = pa_ * (1.0 - pb_), y = (1.0 - pa_) * pb_;
+            double level = (x + y > 0) ? x / (x + y) : 0.5;
+            if (a == b) return level;
+            return a > b ? p + (1-p)*level : p*level;
+        }
+        size_t k = ((size_t)start * target + a) * target + b;
+        if (memo[k] >= 0) return memo[k];
+        double v = p * tiebreak(memo, target, start, a+1, b) + (1-p) * tiebreak(memo, target, start, a, b+1);
+        memo[k] = v;
+        return v;
+    }
+
+    double after_set(int s1, int s2, int srv) const {
+        if (s1 >= sets_to_win_) return 1.0;
+        if (s2 >= sets_to_win_) return 0.0;
+        if (f_.deciding == DECIDING_TB10 && s1 == 1 && s2 == 1) {
+            double t = tiebreak(dec_tb_, f_.deciding_tb_points, srv, 0, 0);
+            return t * after_set(s1+1, s2, 1-srv) + (1-t) * after_set(s1, s2+1, 1-srv);
+        }
+        return game_start(s1, s2, 0, 0, srv);
+    }
+
+    double after_game(int s1, int s2, int g1, int g2, int srv) const {
+        if (set_won(g1, g2)) return after_set(s1+1, s2, srv);
+        if (set_won(g2, g1)) return after_set(s1, s2+1, srv);
+        return game_start(s1, s2, g1, g2, srv);
+    }
+
+    // P(player 1 wins the match) at the start of a game (or of the set
+    // tiebreak, at tiebreak_at_games all).
+    double game_start(int s1, int s2, int g1, int g2, int srv) const {
+        if (g1 >= games_dim_ || g2 >= games_dim_) return 0.5;   // not reachable under this format
+        size_t k = ((((size_t)s1 * sets_to_win_ + s2) * games_dim_ + g1) * games_dim_ + g2) * 2 + srv;
+        if (match_[k] >= 0) return match_[k];
+        double v;
+        if (g1 == f_.tiebreak_at_games && g2 == f_.tiebreak_at_games) {
+            double t = tiebreak(set_tb_, f_.set_tiebreak_points, srv, 0, 0);
+            v = t * after_set(s1+1, s2, 1-srv) + (1-t) * after_set(s1, s2+1, 1-srv);
         } else {
-            pts1 = tennis_point_to_string(st.game_points_p1);
-            pts2 = tennis_point_to_string(st.game_points_p2);
+            double w = (srv==0 ? hold_[0][0][0] : 1.0 - hold_[1][0][0]);
+            v = w * after_game(s1, s2, g1+1, g2, 1-srv) + (1-w) * after_game(s1, s2, g1, g2+1, 1-srv);
         }
+        match_[k] = v;
+        return v;
     }
 
-    cout << "+--------------------------------------------------+\n";
-    cout << "| Location: " << right_pad(st.location, 40) << "|\n";
-    cout << "| " << right_pad(name1, 22) << "| " << right_pad(name2, 15) << "|\n";
-    cout << "| Sets:           " << left_pad(to_string(st.sets_won_p1), 10)
-         << "  | " << left_pad(to_string(st.sets_won_p2), 10) << "|\n";
-    cout << "| Games:          " << left_pad(to_string(g1), 10)
-         << "  | " << left_pad(to_string(g2), 10) << "|\n";
-    cout << "| Points:         " << left_pad(pts1, 10)
-         << "  | " << left_pad(pts2, 10) << "|\n";
-    cout << "+--------------------------------------------------+\n";
+    FormatConfig f_;
+    int sets_to_win_;
+    double pa_, pb_;
+    int games_dim_;
+    // Filled by the constructor; const lookups only read them afterwards,
+    // so one model can be shared between threads.
+    double hold_[2][4][4];   // [server][server pts][receiver pts] before deuce
+    mutable vector<double> set_tb_, dec_tb_;   // [start][a][b]
+    mutable vector<double> match_;   // [s1][s2][g1][g2][server]
+};
+
+// Share of service points won, pulled toward the prior early in a match.
+// Every service point ends as a server point won, a returner point won or
+// a double fault.
+static int quantized_serve_rate(const PlayerStats& server, const PlayerStats& receiver) {
+    int won = server.points_won_on_first_serve + server.points_won_on_second_serve;
+    int lost = receiver.return_points_won_vs_first + receiver.return_points_won_vs_second + server.double_faults;
+    double rate = (won + SERVE_RATE_PRIOR * SERVE_RATE_PRIOR_POINTS) / (won + lost + SERVE_RATE_PRIOR_POINTS);
+    int q = (int)(rate * SERVE_RATE_STEPS + 0.5);
+    return min(max(q, 1), SERVE_RATE_STEPS - 1);
+}
+
+static const WinProbModel& win_prob_model(const FormatConfig& f, int sets_to_win, int qa, int qb) {
+    static unordered_map<uint64_t, unique_ptr<WinProbModel>> cache;
+    uint64_t key = 0;   // one byte per field; all of them are small
+    for (int v : {f.games_to_win_set, f.tiebreak_at_games, f.set_tiebreak_points, (int)f.deciding,
+                  f.deciding_tb_points, sets_to_win, qa, qb})
+        key = (key << 8) | (uint64_t)(v & 0xFF);
+    auto it = cache.find(key);
+    if (it != cache.end()) return *it->second;
+    if (cache.size() >= 256) cache.clear();
+    unique_ptr<WinProbModel>& m = cache[key];
+    m.reset(new WinProbModel(f, sets_to_win, (double)qa / SERVE_RATE_STEPS, (double)qb / SERVE_RATE_STEPS));
+    return *m;
+}
+
+static const WinProbModel& win_prob_model_for(const MatchState& st) {
+    int qa = quantized_serve_rate(st.match_stats_p1, st.match_stats_p2);
+    int qb = quantized_serve_rate(st.match_stats_p2, st.match_stats_p1);
+    return win_prob_model(st.format, st.sets_to_win, qa, qb);
+}
+
+// How much the next point matters (0..1), from the same model.
+static double point_importance(const MatchState& st) {
+    return win_prob_model_for(st).importance(st);
 }
 
 // =============== Stats/ratios printing ===============
 
-static void print_single_player_stats(const PlayerStats& s, const string& title) {
-    cout << title << "\n";
-    cout << "----------------------------------------\n";
-    cout << "Serving:\n";
-    cout << "  First serve:        " << s.first_serves_in << "/" << s.first_serves_attempted
-         << "  (" << safe_percent(s.first_serves_in, s.first_serves_attempted) << ")\n";
-    cout << "  1st pts won:        " << s.points_won_on_first_serve << "/" << s.first_serves_in
-         << "  (" << safe_percent(s.points_won_on_first_serve, s.first_serves_in) << ")\n";
-    cout << "  Second serve:       " << s.second_serves_in << "/" << s.second_serves_attempted
-         << "  (" << safe_percent(s.second_serves_in, s.second_serves_attempted) << ")\n";
-    cout << "  2nd pts won:        " << s.points_won_on_second_serve << "/" << s.second_serves_in
-         << "  (" << safe_percent(s.points_won_on_second_serve, s.second_serves_in) << ")\n";
-    cout << "  Aces (1st/2nd):     " << s.aces_first << " / " << s.aces_second << "\n";
-    cout << "  Service winners:    " << s.service_winners_first << " / " << s.service_winners_second << "\n";
-    cout << "  Double faults:      " << s.double_faults << "\n";
-
-    cout << "Returning:\n";
-    cout << "  vs 1st won:         " << s.return_points_won_vs_first << "\n";
-    cout << "  vs 2nd won:         " << s.return_points_won_vs_second << "\n";
-    cout << "  Return W/UE/FE:     " << s.return_winners << " / " << s.return_unforced_errors << " / " << s.return_forced_errors << "\n";
-
-    cout << "Rallies:\n";
-    cout << "  Winners:            " << s.rally_winners << "\n";
-    cout << "  Unforced errors:    " << s.unforced_errors << "\n";
-    cout << "  Forced drawn:       " << s.forced_errors_drawn << "\n";
-
-    cout << "Net play:\n";
-    cout << "  Net points:         " << s.net_points_won << "/" << s.net_points_total
-         << "  (" << safe_percent(s.net_points_won, s.net_points_total) << ")\n";
-
-    cout << "Pressure:\n";
-    cout << "  Break points:       " << s.break_points_won << "/" << s.break_points_total << "\n";
-
-    cout << "Overall:\n";
-    cout << "  Total points:       " << s.points_won << "/" << s.points_played
-         << "  (" << safe_percent(s.points_won, s.points_played) << ")\n";
-}
-
-static void print_side_by_side(const PlayerStats& a, const PlayerStats& b,
-                               const string& nameA, const string& nameB) {
-    int L = 32;
-    cout << right_pad(nameA, L) << "   " << right_pad(nameB, L) << "\n";
-    cout << right_pad(string(32,'-'), L) << "   " << right_pad(string(32,'-'), L) << "\n";
-    auto line=[&](const string& la,const string& lb){ cout<<right_pad(la,L)<<"   "<<right_pad(lb,L)<<"\n"; };
-    line("First serve:  "+safe_ratio(a.first_serves_in,a.first_serves_attempted)+" ("+safe_percent(a.first_serves_in,a.first_serves_attempted)+")",
-         "First serve:  "+safe_ratio(b.first_serves_in,b.first_serves_attempted)+" ("+safe_percent(b.first_serves_in,b.first_serves_attempted)+")");
-    line("1st pts won:  "+safe_ratio(a.points_won_on_first_serve,a.first_serves_in)+" ("+safe_percent(a.points_won_on_first_serve,a.first_serves_in)+")",
-         "1st pts won:  "+safe_ratio(b.points_won_on_first_serve,b.first_serves_in)+" ("+safe_percent(b.points_won_on_first_serve,b.first_serves_in)+")");
-    line("Second srv:   "+safe_ratio(a.second_serves_in,a.second_serves_attempted)+" ("+safe_percent(a.second_serves_in,a.second_serves_attempted)+")",
-         "Second srv:   "+safe_ratio(b.second_serves_in,b.second_serves_attempted)+" ("+safe_percent(b.second_serves_in,b.second_serves_attempted)+")");
-    line("2nd pts won:  "+safe_ratio(a.points_won_on_second_serve,a.second_serves_in)+" ("+safe_percent(a.points_won_on_second_serve,a.second_serves_in)+")",
-         "2nd pts won:  "+safe_ratio(b.points_won_on_second_serve,b.second_serves_in)+" ("+safe_percent(b.points_won_on_second_serve,b.second_serves_in)+")");
-    {
-        stringstream sa,sb; sa<<"Aces (1/2):   "<<a.aces_first<<" / "<<a.aces_second;
-        sb<<"Aces (1/2):   "<<b.aces_first<<" / "<<b.aces_second; line(sa.str(),sb.str());
-    }
-    {
-        stringstream sa,sb; sa<<"Srv winners:  "<<a.service_winners_first<<" / "<<a.service_winners_second;
-        sb<<"Srv winners:  "<<b.service_winners_first<<" / "<<b.service_winners_second; line(sa.str(),sb.str());
+// Stats views are tables of lines. Each line names the counters it reads, so
+// a cached view can tell exactly which lines a point made stale.
+typedef void (*StatCell)(OutBuf&, const PlayerStats&);
+
+struct StatLine {
+    StatCell render;
+    int PlayerStats::* deps[4];   // null-terminated; none = constant text
+};
+
+static const StatLine SINGLE_PLAYER_LINES[] = {
+    { [](OutBuf& o, const PlayerStats&){ o << "Serving:"; }, {} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  First serve:        " << Ratio{s.first_serves_in, s.first_serves_attempted} << "  (" << Percent{s.first_serves_in, s.first_serves_attempted} << ')'; }, {&PlayerStats::first_serves_in, &PlayerStats::first_serves_attempted} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  1st pts won:        " << Ratio{s.points_won_on_first_serve, s.first_serves_in} << "  (" << Percent{s.points_won_on_first_serve, s.first_serves_in} << ')'; }, {&PlayerStats::points_won_on_first_serve, &PlayerStats::first_serves_in} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Second serve:       " << Ratio{s.second_serves_in, s.second_serves_attempted} << "  (" << Percent{s.second_serves_in, s.second_serves_attempted} << ')'; }, {&PlayerStats::second_serves_in, &PlayerStats::second_serves_attempted} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  2nd pts won:        " << Ratio{s.points_won_on_second_serve, s.second_serves_in} << "  (" << Percent{s.points_won_on_second_serve, s.second_serves_in} << ')'; }, {&PlayerStats::points_won_on_second_serve, &PlayerStats::second_serves_in} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Aces (1st/2nd):     " << s.aces_first << " / " << s.aces_second; }, {&PlayerStats::aces_first, &PlayerStats::aces_second} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Service winners:    " << s.service_winners_first << " / " << s.service_winners_second; }, {&PlayerStats::service_winners_first, &PlayerStats::service_winners_second} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Double faults:      " << s.double_faults; }, {&PlayerStats::double_faults} },
+    { [](OutBuf& o, const PlayerStats&){ o << "Returning:"; }, {} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  vs 1st won:         " << s.return_points_won_vs_first; }, {&PlayerStats::return_points_won_vs_first} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  vs 2nd won:         " << s.return_points_won_vs_second; }, {&PlayerStats::return_points_won_vs_second} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Return W/UE/FE:     " << s.return_winners << " / " << s.return_unforced_errors << " / " << s.return_forced_errors; }, {&PlayerStats::return_winners, &PlayerStats::return_unforced_errors, &PlayerStats::return_forced_errors} },
+    { [](OutBuf& o, const PlayerStats&){ o << "Rallies:"; }, {} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Winners:            " << s.rally_winners; }, {&PlayerStats::rally_winners} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Unforced errors:    " << s.unforced_errors; }, {&PlayerStats::unforced_errors} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Forced drawn:       " << s.forced_errors_drawn; }, {&PlayerStats::forced_errors_drawn} },
+    { [](OutBuf& o, const PlayerStats&){ o << "Net play:"; }, {} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Net points:         " << Ratio{s.net_points_won, s.net_points_total} << "  (" << Percent{s.net_points_won, s.net_points_total} << ')'; }, {&PlayerStats::net_points_won, &PlayerStats::net_points_total} },
+    { [](OutBuf& o, const PlayerStats&){ o << "Pressure:"; }, {} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Break points:       " << Ratio{s.break_points_won, s.break_points_total}; }, {&PlayerStats::break_points_won, &PlayerStats::break_points_total} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Clutch pts won:     " << Percent{s.clutch_weight_won, s.clutch_weight_played} << "  (importance-weighted)"; }, {&PlayerStats::clutch_weight_won, &PlayerStats::clutch_weight_played} },
+    { [](OutBuf& o, const PlayerStats&){ o << "Overall:"; }, {} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "  Total points:       " << Ratio{s.points_won, s.points_played} << "  (" << Percent{s.points_won, s.points_played} << ')'; }, {&PlayerStats::points_won, &PlayerStats::points_played} },
+};
+static const int SINGLE_PLAYER_LINE_COUNT = (int)(sizeof(SINGLE_PLAYER_LINES)/sizeof(SINGLE_PLAYER_LINES[0]));
+
+static const StatLine SIDE_BY_SIDE_LINES[] = {
+    { [](OutBuf& o, const PlayerStats& s){ o << "First serve:  " << Ratio{s.first_serves_in,s.first_serves_attempted} << " (" << Percent{s.first_serves_in,s.first_serves_attempted} << ')'; }, {&PlayerStats::first_serves_in, &PlayerStats::first_serves_attempted} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "1st pts won:  " << Ratio{s.points_won_on_first_serve,s.first_serves_in} << " (" << Percent{s.points_won_on_first_serve,s.first_serves_in} << ')'; }, {&PlayerStats::points_won_on_first_serve, &PlayerStats::first_serves_in} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Second srv:   " << Ratio{s.second_serves_in,s.second_serves_attempted} << " (" << Percent{s.second_serves_in,s.second_serves_attempted} << ')'; }, {&PlayerStats::second_serves_in, &PlayerStats::second_serves_attempted} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "2nd pts won:  " << Ratio{s.points_won_on_second_serve,s.second_serves_in} << " (" << Percent{s.points_won_on_second_serve,s.second_serves_in} << ')'; }, {&PlayerStats::points_won_on_second_serve, &PlayerStats::second_serves_in} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Aces (1/2):   " << s.aces_first << " / " << s.aces_second; }, {&PlayerStats::aces_first, &PlayerStats::aces_second} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Srv winners:  " << s.service_winners_first << " / " << s.service_winners_second; }, {&PlayerStats::service_winners_first, &PlayerStats::service_winners_second} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Double faults: " << s.double_faults; }, {&PlayerStats::double_faults} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Return vs1st: " << s.return_points_won_vs_first; }, {&PlayerStats::return_points_won_vs_first} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Return vs2nd: " << s.return_points_won_vs_second; }, {&PlayerStats::return_points_won_vs_second} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Return W/UE/FE: " << s.return_winners << '/' << s.return_unforced_errors << '/' << s.return_forced_errors; }, {&PlayerStats::return_winners, &PlayerStats::return_unforced_errors, &PlayerStats::return_forced_errors} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Rally winners:" << s.rally_winners; }, {&PlayerStats::rally_winners} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Unforced err: " << s.unforced_errors; }, {&PlayerStats::unforced_errors} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Forced drawn: " << s.forced_errors_drawn; }, {&PlayerStats::forced_errors_drawn} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Net:          " << Ratio{s.net_points_won,s.net_points_total} << " (" << Percent{s.net_points_won,s.net_points_total} << ')'; }, {&PlayerStats::net_points_won, &PlayerStats::net_points_total} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Break points: " << Ratio{s.break_points_won,s.break_points_total}; }, {&PlayerStats::break_points_won, &PlayerStats::break_points_total} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Clutch pts:   " << Percent{s.clutch_weight_won,s.clutch_weight_played}; }, {&PlayerStats::clutch_weight_won, &PlayerStats::clutch_weight_played} },
+    { [](OutBuf& o, const PlayerStats& s){ o << "Total points: " << Ratio{s.points_won,s.points_played} << " (" << Percent{s.points_won,s.points_played} << ')'; }, {&PlayerStats::points_won, &PlayerStats::points_played} },
+};
+static const int SIDE_BY_SIDE_LINE_COUNT = (int)(sizeof(SIDE_BY_SIDE_LINES)/sizeof(SIDE_BY_SIDE_LINES[0]));
+static const int SIDE_BY_SIDE_WIDTH = 32;
+
+// =============== Stats view cache ===============
+// Preformatted stats views keyed by (scope, set, player). A view is reused
+// as-is while the match revision is unchanged; after a point only the cells
+// whose counters moved are formatted again, the rest are copied.
+
+struct CachedStatsView {
+    bool valid = false;
+    uint64_t revision = 0;
+    PlayerStats last[2];
+    vector<string> cells;   // line-major, one per player column
+    string body;
+};
+
+static unordered_map<int, CachedStatsView> stats_view_cache;
+
+static bool stat_line_changed(const StatLine& l, const PlayerStats& now, const PlayerStats& before) {
+    for (int i = 0; i < 4 && l.deps[i]; i++)
+        if (now.*l.deps[i] != before.*l.deps[i]) return true;
+    return false;
+}
+
+// Brings view up to date for the given players (1 or 2 columns).
+static void refresh_stats_view(CachedStatsView& v, uint64_t revision, const StatLine* lines, int line_count,
+                               const PlayerStats* const* players, int columns) {
+    if (v.valid && v.revision == revision) return;
+    if (!v.valid) v.cells.assign((size_t)line_count * columns, string());
+    bool changed = !v.valid;
+    OutBuf cell;
+    for (int r = 0; r < line_count; r++) {
+        for (int c = 0; c < columns; c++) {
+            if (v.valid && !stat_line_changed(lines[r], *players[c], v.last[c])) continue;
+            cell.data.clear();
+            lines[r].render(cell, *players[c]);
+            string& slot = v.cells[(size_t)r * columns + c];
+            if (slot != cell.data) { slot = cell.data; changed = true; }
+        }
     }
-    {
-        stringstream sa,sb; sa<<"Double faults: "<<a.double_faults; sb<<"Double faults: "<<b.double_faults; line(sa.str(),sb.str());
+    for (int c = 0; c < columns; c++) v.last[c] = *players[c];
+    v.revision = revision;
+    v.valid = true;
+    if (!changed) return;
+
+    OutBuf body;
+    body.data.swap(v.body);
+    body.data.clear();
+    for (int r = 0; r < line_count; r++) {
+        for (int c = 0; c < columns; c++) {
+            size_t start = body.data.size();
+            body << v.cells[(size_t)r * columns + c];
+            if (columns > 1) {
+                pad_from(body, start, SIDE_BY_SIDE_WIDTH);
+                if (c + 1 < columns) body << "   ";
+            }
+        }
+        body << '\n';
     }
-    line("Return vs1st: "+to_string(a.return_points_won_vs_first),
-         "Return vs1st: "+to_string(b.return_points_won_vs_first));
-    line("Return vs2nd: "+to_string(a.return_points_won_vs_second),
-         "Return vs2nd: "+to_string(b.return_points_won_vs_second));
-    {
-        stringstream sa,sb; sa<<"Return W/UE/FE: "<<a.return_winners<<"/"<<a.return_unforced_errors<<"/"<<a.return_forced_errors;
-        sb<<"Return W/UE/FE: "<<b.return_winners<<"/"<<b.return_unforced_errors<<"/"<<b.return_forced_errors; line(sa.str(),sb.str());
-    }
-    line("Rally winners:"+to_string(a.rally_winners),
-         "Rally winners:"+to_string(b.rally_winners));
-    line("Unforced err: "+to_string(a.unforced_errors),
-         "Unforced err: "+to_string(b.unforced_errors));
-    line("Forced drawn: "+to_string(a.forced_errors_drawn),
-         "Forced drawn: "+to_string(b.forced_errors_drawn));
-    line("Net:          "+safe_ratio(a.net_points_won,a.net_points_total)+" ("+safe_percent(a.net_points_won,a.net_points_total)+")",
-         "Net:          "+safe_ratio(b.net_points_won,b.net_points_total)+" ("+safe_percent(b.net_points_won,b.net_points_total)+")");
-    line("Break points: "+safe_ratio(a.break_points_won,a.break_points_total),
-         "Break points: "+safe_ratio(b.break_points_won,b.break_points_total));
-    line("Total points: "+safe_ratio(a.points_won,a.points_played)+" ("+safe_percent(a.points_won,a.points_played)+")",
-         "Total points: "+safe_ratio(b.points_won,b.points_played)+" ("+safe_percent(b.points_won,b.points_played)+")");
+    v.body.swap(body.data);
 }
 
 // =============== Scoring helpers ===============
@@ -330,6 +920,18 @@ static void print_side_by_side(const PlayerStats& a, const PlayerStats& b,
 static void start_new_set(class MatchState& st);
 static void award_game(MatchState& st, int player);
 
+// Server of the next tiebreak point, without the change-ends cue.
+static int tiebreak_server(const MatchState& st) {
+    // Enforce 1–2–2 pattern:
+    // Points indexed from 0: 0:S, 1:O, 2:O, 3:S, 4:S, 5:O, 6:O, 7:S, ...
+    // So, server = tb_start_server if (i%4==0 or i%4==3), else opponent.
+    int total = st.tb_points_p1 + st.tb_points_p2; // points already played
+    int mod4 = total % 4;
+    int start = st.tb_start_server;
+    int opp = (start==0?1:0);
+    return (mod4==0 || mod4==3) ? start : opp;
+}
+
 static bool is_game_point_for(int gp_winner, int gp_loser) {
     if (gp_winner <= 2) return false;
     if (gp_winner == 3 && gp_loser <= 2) return true; // at 40 vs <40
@@ -523,201 +1125,3583 @@ static void maybe_count_break_point(MatchState& st, bool was_bp, bool returner_w
     ms.break_points_total++; ps.break_points_total++;
     if (returner_won) { ms.break_points_won++; ps.break_points_won++; }
 }
+// Weights the point by its importance for both players.
+static void count_point_importance(MatchState& st, double importance, bool returner_won) {
+    int w = (int)(importance * IMPORTANCE_SCALE + 0.5);
+    int returner_player = (st.current_server==0?1:0);
+    int winner = returner_won ? returner_player : st.current_server;
+    for (int p=0;p<2;p++) {
+        PlayerStats& ms = (p==0? st.match_stats_p1 : st.match_stats_p2);
+        PlayerStats& ps = (p==0? st.per_set_stats_p1[st.current_set_index] : st.per_set_stats_p2[st.current_set_index]);
+        ms.clutch_weight_played += w; ps.clutch_weight_played += w;
+        if (p == winner) { ms.clutch_weight_won += w; ps.clutch_weight_won += w; }
+    }
+}
 
 // =============== CSV Exports ===============
 
-static void save_csvs(const MatchState& st, const string& base) {
-    // 1) Match totals CSV
-    {
-        ofstream f((base+"_match_totals.csv").c_str());
-        if (f) {
-            f << "Player,FirstServIn,FirstServAtt,FirstPtsWon,SecondServIn,SecondServAtt,SecondPtsWon,Aces1,Aces2,SrvW1,SrvW2,DF,RetWonV1,RetWonV2,RetW,RetUE,RetFE,RallyW,UE,FEdrawn,NetWon,NetTot,BPWon,BPTot,PtsWon,PtsPlayed\n";
-            auto dump=[&](const string& name,const PlayerStats& s){
-                f<<name<<","<<s.first_serves_in<<","<<s.first_serves_attempted<<","<<s.points_won_on_first_serve<<","
-                 <<s.second_serves_in<<","<<s.second_serves_attempted<<","<<s.points_won_on_second_serve<<","
-                 <<s.aces_first<<","<<s.aces_second<<","<<s.service_winners_first<<","<<s.service_winners_second<<","
-                 <<s.double_faults<<","<<s.return_points_won_vs_first<<","<<s.return_points_won_vs_second<<","
-                 <<s.return_winners<<","<<s.return_unforced_errors<<","<<s.return_forced_errors<<","
-                 <<s.rally_winners<<","<<s.unforced_errors<<","<<s.forced_errors_drawn<<","
-                 <<s.net_points_won<<","<<s.net_points_total<<","<<s.break_points_won<<","<<s.break_points_total<<","
-                 <<s.points_won<<","<<s.points_played<<"\n";
-            };
-            dump(st.player1_name, st.match_stats_p1);
-            dump(st.player2_name, st.match_stats_p2);
-        }
-    }
-    // 2) Per-set CSV
-    {
-        ofstream f((base+"_per_set_stats.csv").c_str());
-        if (f) {
-            f << "Set,Player,FirstServIn,FirstServAtt,FirstPtsWon,SecondServIn,SecondServAtt,SecondPtsWon,Aces1,Aces2,SrvW1,SrvW2,DF,RetWonV1,RetWonV2,RetW,RetUE,RetFE,RallyW,UE,FEdrawn,NetWon,NetTot,BPWon,BPTot,PtsWon,PtsPlayed\n";
-            for (size_t i=0;i<st.sets.size();i++) {
-                auto dump=[&](const string& name,const PlayerStats& s){
-                    f<<(i+1)<<","<<name<<","<<s.first_serves_in<<","<<s.first_serves_attempted<<","<<s.points_won_on_first_serve<<","
-                     <<s.second_serves_in<<","<<s.second_serves_attempted<<","<<s.points_won_on_second_serve<<","
-                     <<s.aces_first<<","<<s.aces_second<<","<<s.service_winners_first<<","<<s.service_winners_second<<","
-                     <<s.double_faults<<","<<s.return_points_won_vs_first<<","<<s.return_points_won_vs_second<<","
-                     <<s.return_winners<<","<<s.return_unforced_errors<<","<<s.return_forced_errors<<","
-                     <<s.rally_winners<<","<<s.unforced_errors<<","<<s.forced_errors_drawn<<","
-                     <<s.net_points_won<<","<<s.net_points_total<<","<<s.break_points_won<<","<<s.break_points_total<<","
-                     <<s.points_won<<","<<s.points_played<<"\n";
-                };
-                dump(st.player1_name, st.per_set_stats_p1[i]);
-                dump(st.player2_name, st.per_set_stats_p2[i]);
-            }
-        }
+static void dump_stats_csv_fields(OutBuf& f, const PlayerStats& s) {
+    for (int i=0;i<STAT_FIELD_COUNT;i++) f << s.*STAT_FIELDS[i] << (i+1<STAT_FIELD_COUNT ? ',' : '\n');
+}
+
+static void render_totals_csv(OutBuf& f, const MatchState& st) {
+    f << "Player,FirstServIn,FirstServAtt,FirstPtsWon,SecondServIn,SecondServAtt,SecondPtsWon,Aces1,Aces2,SrvW1,SrvW2,DF,RetWonV1,RetWonV2,RetW,RetUE,RetFE,RallyW,UE,FEdrawn,NetWon,NetTot,BPWon,BPTot,PtsWon,PtsPlayed,ClutchWon,ClutchPlayed\n";
+    f << st.player1_name << ','; dump_stats_csv_fields(f, st.match_stats_p1);
+    f << st.player2_name << ','; dump_stats_csv_fields(f, st.match_stats_p2);
+}
+
+static void render_per_set_csv(OutBuf& f, const MatchState& st) {
+    f << "Set,Player,FirstServIn,FirstServAtt,FirstPtsWon,SecondServIn,SecondServAtt,SecondPtsWon,Aces1,Aces2,SrvW1,SrvW2,DF,RetWonV1,RetWonV2,RetW,RetUE,RetFE,RallyW,UE,FEdrawn,NetWon,NetTot,BPWon,BPTot,PtsWon,PtsPlayed,ClutchWon,ClutchPlayed\n";
+    for (size_t i=0;i<st.sets.size();i++) {
+        f << (i+1) << ',' << st.player1_name << ','; dump_stats_csv_fields(f, st.per_set_stats_p1[i]);
+        f << (i+1) << ',' << st.player2_name << ','; dump_stats_csv_fields(f, st.per_set_stats_p2[i]);
     }
-    // 3) Point-by-point CSV
-    {
-        ofstream f((base+"_points.csv").c_str());
-        if (f) {
-            f << "Idx,Set,Game,TB,Server,ServeType,Winner,BP,GP,SP,MP,Event\n";
-            for (size_t i=0;i<st.log_entries.size();i++) {
-                const auto& e=st.log_entries[i];
-                f<<(i+1)<<","<<(e.set_index+1)<<","<<(e.game_index+1)<<","<<(e.in_tiebreak?"Y":"N")<<","
-                 <<(e.server_player==0?"P1":"P2")<<","
-                 <<(e.serve_type==SERVE_FIRST?"1st":(e.serve_type==SERVE_SECOND?"2nd":"-"))<<","
-                 <<(e.point_winner==0?"P1":"P2")<<","
-                 <<(e.was_break_point?"Y":"N")<<","
-                 <<(e.was_game_point?"Y":"N")<<","
-                 <<(e.was_set_point?"Y":"N")<<","
-                 <<(e.was_match_point?"Y":"N")<<",";
-                // naive CSV escaping for commas/quotes
-                string ev=e.event_chain;
-                for(char& c:ev){ if(c=='"'){ c='\'';
-                } }
-                f<<"\""<<ev<<"\""<<"\n";
-            }
-        }
+}
+
+static void render_points_csv(OutBuf& f, const MatchState& st) {
+    f << "Idx,Set,Game,TB,Server,ServeType,Winner,BP,GP,SP,MP,Event,Importance\n";
+    for (size_t i=0;i<st.log_entries.size();i++) {
+        const auto& e=st.log_entries[i];
+        f<<(i+1)<<','<<(e.set_index+1)<<','<<(e.game_index+1)<<','<<(e.in_tiebreak?"Y":"N")<<','
+         <<(e.server_player==0?"P1":"P2")<<','
+         <<(e.serve_type==SERVE_FIRST?"1st":(e.serve_type==SERVE_SECOND?"2nd":"-"))<<','
+         <<(e.point_winner==0?"P1":"P2")<<','
+         <<(e.was_break_point?"Y":"N")<<','
+         <<(e.was_game_point?"Y":"N")<<','
+         <<(e.was_set_point?"Y":"N")<<','
+         <<(e.was_match_point?"Y":"N")<<',';
+        // naive CSV escaping for commas/quotes
+        f<<'"';
+        for (char c : e.event_chain) f<<(c=='"' ? '\'' : c);
+        f<<'"'<<','<<Fixed{e.importance, 4}<<'\n';
     }
 }
 
 // =============== Save TXT/JSON ===============
 
-static void save_match_files(const MatchState& st) {
-    string base = st.player1_name + "_vs_" + st.player2_name + "_" + now_date_time_string();
-    for (char& c : base) if (c==' ') c='_';
-
-    string txtName = base + ".txt";
-    string jsonName = base + ".json";
-
-    ofstream txt(txtName.c_str());
-    if (txt) {
-        txt << "Match Summary\n=============\n";
-        txt << "Players: " << st.player1_name << " vs " << st.player2_name << "\n";
-        txt << "Location: " << st.location << "\n";
-        txt << "Format: Best-of-3; sets to " << st.format.games_to_win_set
-            << " (TB" << st.format.set_tiebreak_points << " at "
-            << st.format.tiebreak_at_games << "-" << st.format.tiebreak_at_games << ")";
-        if (st.format.deciding==DECIDING_TB10) txt << "; deciding TB10";
-        txt << "\n\nFinal Set Scores:\n";
-        for (size_t i=0;i<st.sets.size();i++) {
-            const SetScore& s = st.sets[i];
-            txt << "  Set " << (i+1) << ": " << s.games_player1 << "-" << s.games_player2;
-            if (s.set_tiebreak_played) txt << " (TB " << s.tb_points_p1 << "-" << s.tb_points_p2 << ")";
-            txt << "\n";
-        }
-        auto sum_stats=[&](const PlayerStats& s, const string& title){
-            txt << "\n" << title << "\n----------------------------------------\n";
-            txt << "First serve: " << s.first_serves_in << "/" << s.first_serves_attempted
-                << " (" << safe_percent(s.first_serves_in, s.first_serves_attempted) << ")\n";
-            txt << "1st pts won: " << s.points_won_on_first_serve << "/" << s.first_serves_in
-                << " (" << safe_percent(s.points_won_on_first_serve, s.first_serves_in) << ")\n";
-            txt << "Second srv:  " << s.second_serves_in << "/" << s.second_serves_attempted
-                << " (" << safe_percent(s.second_serves_in, s.second_serves_attempted) << ")\n";
-            txt << "2nd pts won: " << s.points_won_on_second_serve << "/" << s.second_serves_in
-                << " (" << safe_percent(s.points_won_on_second_serve, s.second_serves_in) << ")\n";
-            txt << "Aces (1/2):  " << s.aces_first << " / " << s.aces_second << "\n";
-            txt << "Srv winners: " << s.service_winners_first << " / " << s.service_winners_second << "\n";
-            txt << "Double faults: " << s.double_faults << "\n";
-            txt << "Return vs1st: " << s.return_points_won_vs_first << "\n";
-            txt << "Return vs2nd: " << s.return_points_won_vs_second << "\n";
-            txt << "Return W/UE/FE: " << s.return_winners << "/" << s.return_unforced_errors << "/" << s.return_forced_errors << "\n";
-            txt << "Rally winners: " << s.rally_winners << "\n";
-            txt << "Unforced err: " << s.unforced_errors << "\n";
-            txt << "Forced drawn: " << s.forced_errors_drawn << "\n";
-            txt << "Net: " << s.net_points_won << "/" << s.net_points_total
-                << " (" << safe_percent(s.net_points_won, s.net_points_total) << ")\n";
-            txt << "Break points: " << s.break_points_won << "/" << s.break_points_total << "\n";
-            txt << "Total points: " << s.points_won << "/" << s.points_played
-                << " (" << safe_percent(s.points_won, s.points_played) << ")\n";
-        };
-        sum_stats(st.match_stats_p1, "Player: "+st.player1_name+" (Match Totals)");
-        sum_stats(st.match_stats_p2, "Player: "+st.player2_name+" (Match Totals)");
-
-        txt << "\nPer-set stats\n-------------\n";
-        for (size_t i=0;i<st.sets.size();i++) {
-            txt << "Set " << (i+1) << ":\n";
-            sum_stats(st.per_set_stats_p1[i], "  "+st.player1_name);
-            sum_stats(st.per_set_stats_p2[i], "  "+st.player2_name);
-        }
-
-        txt << "\nPoint-by-point log\n-------------------\n";
-        txt << "# | Set | Game | TB | Server | Serve | Winner | BP/GP/SP/MP | Event\n";
-        for (size_t i=0;i<st.log_entries.size();i++) {
-            const auto& e=st.log_entries[i];
-            txt<<(i+1)<<" | "<<(e.set_index+1)<<" | "<<(e.game_index+1)<<" | "<<(e.in_tiebreak?"Y":"N")
-               <<" | "<<(e.server_player==0?st.player1_name:st.player2_name)<<" | "
-               <<(e.serve_type==SERVE_FIRST?"1st":(e.serve_type==SERVE_SECOND?"2nd":"-"))<<" | "
-               <<(e.point_winner==0?st.player1_name:st.player2_name)<<" | "
-               <<(e.was_break_point?"BP":"")<<(e.was_game_point?" GP":"")
-               <<(e.was_set_point?" SP":"")<<(e.was_match_point?" MP":"")
-               <<" | "<<e.event_chain<<"\n";
-        }
-        txt.close();
-        cout << "Saved text summary: " << txtName << "\n";
-    }
-
-    ofstream js(jsonName.c_str());
-    if (js) {
-        js<<"{\n";
-        js<<"  \"players\": [\""<<st.player1_name<<"\", \""<<st.player2_name<<"\"],\n";
-        js<<"  \"location\": \""<<st.location<<"\",\n";
-        js<<"  \"format\": {\"games_to_win_set\": "<<st.format.games_to_win_set
-          <<", \"tiebreak_at_games\": "<<st.format.tiebreak_at_games
-          <<", \"set_tiebreak_points\": "<<st.format.set_tiebreak_points
-          <<", \"deciding_tb10\": "<<(st.format.deciding==DECIDING_TB10?"true":"false")<<"},\n";
-        js<<"  \"sets\": [\n";
-        for (size_t i=0;i<st.sets.size();i++) {
-            const auto& s=st.sets[i];
-            js<<"    {\"p1\": "<<s.games_player1<<", \"p2\": "<<s.games_player2
-              <<", \"tb\": "<<(s.set_tiebreak_played?"true":"false")
-              <<", \"tb_p1\": "<<s.tb_points_p1<<", \"tb_p2\": "<<s.tb_points_p2<<"}";
-            if (i+1<st.sets.size()) js<<",";
-            js<<"\n";
-        }
-        js<<"  ],\n";
-        js<<"  \"log\": [\n";
-        for (size_t i=0;i<st.log_entries.size();i++) {
-            const auto& e=st.log_entries[i];
-            js<<"    {\"idx\":"<<(i+1)
-              <<", \"set\":"<<(e.set_index+1)
-              <<", \"game\":"<<(e.game_index+1)
-              <<", \"tb\":"<<(e.in_tiebreak?"true":"false")
-              <<", \"server\":"<<(e.server_player==0?"\"P1\"":"\"P2\"")
-              <<", \"serve_type\":"<<(e.serve_type==SERVE_FIRST?"\"1st\"":(e.serve_type==SERVE_SECOND?"\"2nd\"":"\"-\""))
-              <<", \"winner\":"<<(e.point_winner==0?"\"P1\"":"\"P2\"")
-              <<", \"bp\":"<<(e.was_break_point?"true":"false")
-              <<", \"gp\":"<<(e.was_game_point?"true":"false")
-              <<", \"sp\":"<<(e.was_set_point?"true":"false")
-              <<", \"mp\":"<<(e.was_match_point?"true":"false")
-              <<", \"event\":\"";
-            for(char c: e.event_chain){ if(c=='"') js<<"\\\""; else if(c=='\\') js<<"\\\\"; else js<<c; }
-            js<<"\"}";
-            if (i+1<st.log_entries.size()) js<<",";
-            js<<"\n";
-        }
-        js<<"  ]\n}\n";
-        js.close();
-        cout << "Saved JSON data: " << jsonName << "\n";
-    }
-
-    // CSV bundle
-    save_csvs(st, base);
-    cout << "Saved CSVs: " << base << "_match_totals.csv, _per_set_stats.csv, _points.csv\n";
+static void render_stats_txt(OutBuf& txt, const PlayerStats& s, const string& title) {
+    txt << '\n' << title << "\n----------------------------------------\n";
+    txt << "First serve: " << s.first_serves_in << '/' << s.first_serves_attempted
+        << " (" << Percent{s.first_serves_in, s.first_serves_attempted} << ")\n";
+    txt << "1st pts won: " << s.points_won_on_first_serve << '/' << s.first_serves_in
+        << " (" << Percent{s.points_won_on_first_serve, s.first_serves_in} << ")\n";
+    txt << "Second srv:  " << s.second_serves_in << '/' << s.second_serves_attempted
+        << " (" << Percent{s.second_serves_in, s.second_serves_attempted} << ")\n";
+    txt << "2nd pts won: " << s.points_won_on_second_serve << '/' << s.second_serves_in
+        << " (" << Percent{s.points_won_on_second_serve, s.second_serves_in} << ")\n";
+    txt << "Aces (1/2):  " << s.aces_first << " / " << s.aces_second << '\n';
+    txt << "Srv winners: " << s.service_winners_first << " / " << s.service_winners_second << '\n';
+    txt << "Double faults: " << s.double_faults << '\n';
+    txt << "Return vs1st: " << s.return_points_won_vs_first << '\n';
+    txt << "Return vs2nd: " << s.return_points_won_vs_second << '\n';
+    txt << "Return W/UE/FE: " << s.return_winners << '/' << s.return_unforced_errors << '/' << s.return_forced_errors << '\n';
+    txt << "Rally winners: " << s.rally_winners << '\n';
+    txt << "Unforced err: " << s.unforced_errors << '\n';
+    txt << "Forced drawn: " << s.forced_errors_drawn << '\n';
+    txt << "Net: " << s.net_points_won << '/' << s.net_points_total
+        << " (" << Percent{s.net_points_won, s.net_points_total} << ")\n";
+    txt << "Break points: " << s.break_points_won << '/' << s.break_points_total << '\n';
+    txt << "Clutch pts won: " << Percent{s.clutch_weight_won, s.clutch_weight_played} << " (importance-weighted)\n";
+    txt << "Total points: " << s.points_won << '/' << s.points_played
+        << " (" << Percent{s.points_won, s.points_played} << ")\n";
 }
 
-// =============== Menus ===============
+// The "# | Set | Game ..." point table, shared by the txt export and the
+// point-by-point stats view.
+static void render_point_log_table(OutBuf& o, const MatchState& st) {
+    const string* names[2] = { &st.player1_name, &st.player2_name };
+    o << "# | Set | Game | TB | Server | Serve | Winner | BP/GP/SP/MP | Event\n";
+    for (size_t i=0;i<st.log_entries.size();i++) {
+        const auto& e=st.log_entries[i];
+        o<<(i+1)<<" | "<<(e.set_index+1)<<" | "<<(e.game_index+1)<<" | "<<(e.in_tiebreak?"Y":"N")
+         <<" | "<<*names[e.server_player]<<" | "
+         <<(e.serve_type==SERVE_FIRST?"1st":(e.serve_type==SERVE_SECOND?"2nd":"-"))<<" | "
+         <<*names[e.point_winner]<<" | "
+         <<(e.was_break_point?"BP":"")<<(e.was_game_point?" GP":"")
+         <<(e.was_set_point?" SP":"")<<(e.was_match_point?" MP":"")
+         <<" | "<<e.event_chain<<'\n';
+    }
+}
+
+static void render_match_txt(OutBuf& txt, const MatchState& st) {
+    txt << "Match Summary\n=============\n";
+    txt << "Players: " << st.player1_name << " vs " << st.player2_name << '\n';
+    txt << "Location: " << st.location << '\n';
+    txt << "Format: Best-of-3; sets to " << st.format.games_to_win_set
+        << " (TB" << st.format.set_tiebreak_points << " at "
+        << st.format.tiebreak_at_games << '-' << st.format.tiebreak_at_games << ')';
+    if (st.format.deciding==DECIDING_TB10) txt << "; deciding TB10";
+    txt << "\n\nFinal Set Scores:\n";
+    for (size_t i=0;i<st.sets.size();i++) {
+        const SetScore& s = st.sets[i];
+        txt << "  Set " << (i+1) << ": " << s.games_player1 << '-' << s.games_player2;
+        if (s.set_tiebreak_played) txt << " (TB " << s.tb_points_p1 << '-' << s.tb_points_p2 << ')';
+        txt << '\n';
+    }
+    render_stats_txt(txt, st.match_stats_p1, "Player: "+st.player1_name+" (Match Totals)");
+    render_stats_txt(txt, st.match_stats_p2, "Player: "+st.player2_name+" (Match Totals)");
+
+    txt << "\nPer-set stats\n-------------\n";
+    for (size_t i=0;i<st.sets.size();i++) {
+        txt << "Set " << (i+1) << ":\n";
+        render_stats_txt(txt, st.per_set_stats_p1[i], "  "+st.player1_name);
+        render_stats_txt(txt, st.per_set_stats_p2[i], "  "+st.player2_name);
+    }
+
+    txt << "\nPoint-by-point log\n-------------------\n";
+    render_point_log_table(txt, st);
+}
+
+static void render_point_json(OutBuf& js, const PointLogEntry& e, size_t idx) {
+    js<<"{\"idx\":"<<idx
+      <<", \"set\":"<<(e.set_index+1)
+      <<", \"game\":"<<(e.game_index+1)
+      <<", \"tb\":"<<(e.in_tiebreak?"true":"false")
+      <<", \"server\":"<<(e.server_player==0?"\"P1\"":"\"P2\"")
+      <<", \"serve_type\":"<<(e.serve_type==SERVE_FIRST?"\"1st\"":(e.serve_type==SERVE_SECOND?"\"2nd\"":"\"-\""))
+      <<", \"winner\":"<<(e.point_winner==0?"\"P1\"":"\"P2\"")
+      <<", \"bp\":"<<(e.was_break_point?"true":"false")
+      <<", \"gp\":"<<(e.was_game_point?"true":"false")
+      <<", \"sp\":"<<(e.was_set_point?"true":"false")
+      <<", \"mp\":"<<(e.was_match_point?"true":"false")
+      <<", \"importance\":"<<Fixed{e.importance, 4}
+      <<", \"event\":\"";
+    for(char c: e.event_chain){ if(c=='"') js<<"\\\""; else if(c=='\\') js<<"\\\\"; else js<<c; }
+    js<<"\"}";
+}
+
+static void render_match_json(OutBuf& js, const MatchState& st) {
+    js<<"{\n";
+    js<<"  \"players\": [\""<<st.player1_name<<"\", \""<<st.player2_name<<"\"],\n";
+    js<<"  \"location\": \""<<st.location<<"\",\n";
+    js<<"  \"format\": {\"games_to_win_set\": "<<st.format.games_to_win_set
+      <<", \"tiebreak_at_games\": "<<st.format.tiebreak_at_games
+      <<", \"set_tiebreak_points\": "<<st.format.set_tiebreak_points
+      <<", \"deciding_tb10\": "<<(st.format.deciding==DECIDING_TB10?"true":"false")<<"},\n";
+    js<<"  \"sets\": [\n";
+    for (size_t i=0;i<st.sets.size();i++) {
+        const auto& s=st.sets[i];
+        js<<"    {\"p1\": "<<s.games_player1<<", \"p2\": "<<s.games_player2
+          <<", \"tb\": "<<(s.set_tiebreak_played?"true":"false")
+          <<", \"tb_p1\": "<<s.tb_points_p1<<", \"tb_p2\": "<<s.tb_points_p2<<'}';
+        if (i+1<st.sets.size()) js<<',';
+        js<<'\n';
+    }
+    js<<"  ],\n";
+    auto stats_array=[&](const PlayerStats& ps){
+        js<<'[';
+        for (int i=0;i<STAT_FIELD_COUNT;i++) js<<(i?",":"")<<ps.*STAT_FIELDS[i];
+        js<<']';
+    };
+    js<<"  \"stats\": {\"p1\": "; stats_array(st.match_stats_p1);
+    js<<", \"p2\": "; stats_array(st.match_stats_p2);
+    js<<", \"sets_p1\": [";
+    for (size_t i=0;i<st.per_set_stats_p1.size();i++) { if (i) js<<", "; stats_array(st.per_set_stats_p1[i]); }
+    js<<"], \"sets_p2\": [";
+    for (size_t i=0;i<st.per_set_stats_p2.size();i++) { if (i) js<<", "; stats_array(st.per_set_stats_p2[i]); }
+    js<<"]},\n";
+    js<<"  \"log\": [\n";
+    for (size_t i=0;i<st.log_entries.size();i++) {
+        const auto& e=st.log_entries[i];
+        js<<"    ";
+        render_point_json(js, e, i+1);
+        if (i+1<st.log_entries.size()) js<<',';
+        js<<'\n';
+    }
+    js<<"  ]\n}\n";
+}
+
+// =============== Core point logic ===============
+
+static void give_point_regular(MatchState& st, int winner_player) {
+    if (winner_player==0) st.game_points_p1++; else st.game_points_p2++;
+    int p1=st.game_points_p1, p2=st.game_points_p2;
+    if (p1>=4 || p2>=4) {
+        if (abs(p1-p2)>=2) {
+            int game_winner = (p1>p2?0:1);
+            award_game(st, game_winner);
+            if (!st.in_match_tiebreak10 && check_enter_set_tiebreak(st)) {
+                st.in_set_tiebreak=true;
+                st.sets[st.current_set_index].set_tiebreak_played=true;
+                st.tb_points_p1=0; st.tb_points_p2=0;
+                // who serves first in set tiebreak? the next to serve — which is current_server now
+                st.tb_start_server = st.current_server;
+            }
+            int set_winner=-1;
+            if (!st.in_set_tiebreak) {
+                if (set_is_won_now(st, set_winner)) {
+                    close_set_and_prepare_next(st, set_winner);
+                }
+            }
+        }
+    }
+}
+
+static void give_point_tiebreak(MatchState& st, int winner_player, bool is_set_tb) {
+    if (winner_player==0) st.tb_points_p1++; else st.tb_points_p2++;
+    if (is_set_tb) {
+        int set_winner=-1;
+        if (set_is_won_now(st, set_winner)) {
+            st.sets[st.current_set_index].tb_points_p1=st.tb_points_p1;
+            st.sets[st.current_set_index].tb_points_p2=st.tb_points_p2;
+            st.in_set_tiebreak=false;
+            close_set_and_prepare_next(st, set_winner);
+        }
+    } else {
+        int mw=-1;
+        if (match_tiebreak10_won(st, mw)) {
+            if (mw==0) st.sets_won_p1++; else st.sets_won_p2++;
+            // add a final “set row” to display TB10 as a decider visually
+            SetScore fin;
+            fin.games_player1 = st.sets.back().games_player1;
+            fin.games_player2 = st.sets.back().games_player2;
+            fin.set_tiebreak_played = true;
+            fin.tb_points_p1 = st.tb_points_p1;
+            fin.tb_points_p2 = st.tb_points_p2;
+            st.sets.push_back(fin);
+            // inside match_tiebreak10_won(...) right after: st.sets.push_back(fin);
+            st.per_set_stats_p1.push_back(PlayerStats());
+            st.per_set_stats_p2.push_back(PlayerStats());
+            st.in_match_tiebreak10=false;
+        }
+    }
+}
+
+// One point as the menu keys that describe it, in the order they are asked.
+// Live entry reads one from the menus; the synthetic generator makes them
+// up. Either way apply_point_event is the only thing that scores a point.
+struct PointEvent {
+    int serve = 0;        // serve menu, 1-8
+    int second = 0;       // after a first-serve fault (serve 2): 1 in, 2 double fault
+    int ret = 0;          // return menu, 1-4, when the serve went in
+    int rally = 0;        // rally menu, 1-6, when the return went in
+    int net_player = -1;  // rally only: who was marked at the net, -1 = nobody
+};
+
+// The serve -> return -> rally questions as a resumable state machine. feed()
+// takes one menu answer and says what comes next, so the caller decides
+// where answers come from: the terminal menus below, or the court server,
+// which keeps a half-entered point per court between network reads.
+enum EntryStage { ENTRY_SERVE, ENTRY_SECOND, ENTRY_RETURN, ENTRY_RALLY, ENTRY_NET, ENTRY_NET_PLAYER, ENTRY_DONE };
+enum EntryResult { ENTRY_NEXT, ENTRY_COMPLETE, ENTRY_INVALID, ENTRY_ADMIN };
+
+static const char* const ENTRY_STAGE_NAMES[] = { "serve", "second", "return", "rally", "net", "net_player", "done" };
+
+class PointEntry {
+public:
+    EntryStage stage() const { return stage_; }
+    const PointEvent& event() const { return ev_; }
+
+    EntryResult feed(int key) {
+        switch (stage_) {
+        case ENTRY_SERVE:
+            if (key==9) return ENTRY_ADMIN;
+            if (key==2) { ev_.serve = 2; stage_ = ENTRY_SECOND; return ENTRY_NEXT; }
+            if (key==1 || key==3) { ev_.serve = key; stage_ = ENTRY_RETURN; return ENTRY_NEXT; }
+            if (key>=4 && key<=8) { ev_.serve = key; stage_ = ENTRY_DONE; return ENTRY_COMPLETE; }
+            return ENTRY_INVALID;
+        case ENTRY_SECOND:
+            if (key<1 || key>2) return ENTRY_INVALID;
+            ev_.second = key;
+            if (ev_.second==2) { stage_ = ENTRY_DONE; return ENTRY_COMPLETE; }
+            stage_ = ENTRY_RETURN;
+            return ENTRY_NEXT;
+        case ENTRY_RETURN:
+            if (key>=1 && key<=3) { ev_.ret = key; stage_ = ENTRY_DONE; return ENTRY_COMPLETE; }
+            if (key==4) { ev_.ret = 4; stage_ = ENTRY_RALLY; return ENTRY_NEXT; }
+            return ENTRY_INVALID;
+        case ENTRY_RALLY:
+            if (key<1 || key>6) return ENTRY_INVALID;
+            ev_.rally = key;
+            stage_ = ENTRY_NET;
+            return ENTRY_NEXT;
+        case ENTRY_NET:
+            if (key<1 || key>2) return ENTRY_INVALID;
+            ev_.net_player = -1;
+            if (key==2) { stage_ = ENTRY_NET_PLAYER; return ENTRY_NEXT; }
+            stage_ = ENTRY_DONE;
+            return ENTRY_COMPLETE;
+        case ENTRY_NET_PLAYER:
+            if (key<1 || key>2) return ENTRY_INVALID;
+            ev_.net_player = key - 1;
+            stage_ = ENTRY_DONE;
+            return ENTRY_COMPLETE;
+        default:
+            return ENTRY_INVALID;
+        }
+    }
+
+private:
+    EntryStage stage_ = ENTRY_SERVE;
+    PointEvent ev_;
+};
+
+static void add_event(PointLogEntry& e, const char* text) {
+    AllocSiteScope site(SITE_EVENT_CHAIN);
+    e.event_chain += text;
+}
+
+// The stats and log-entry half of a point; the score is left alone.
+// Returns the point winner.
+static int count_point_event(MatchState& st, const PointEvent& ev) {
+    // Flags before point (regular games only)
+    bool was_break_point=false, was_game_point=false, was_set_point=false, was_match_point=false;
+    if (!st.in_set_tiebreak && !st.in_match_tiebreak10) {
+        was_break_point = is_break_point_if_receiver_wins(st);
+        bool gp_p1 = is_game_point_for(st.game_points_p1, st.game_points_p2);
+        bool gp_p2 = is_game_point_for(st.game_points_p2, st.game_points_p1);
+        was_game_point = (gp_p1 || gp_p2);
+        was_set_point = (is_set_point_if_player_wins(st,0) || is_set_point_if_player_wins(st,1));
+        was_match_point = (is_match_point_if_player_wins(st,0) || is_match_point_if_player_wins(st,1));
+    }
+
+    PointLogEntry entry;
+    entry.set_index = st.current_set_index;
+    entry.game_index = st.sets[st.current_set_index].games_player1 + st.sets[st.current_set_index].games_player2;
+    entry.in_tiebreak = (st.in_set_tiebreak || st.in_match_tiebreak10);
+    entry.tiebreak_point_number = (st.tb_points_p1 + st.tb_points_p2 + 1);
+    entry.point_number_in_game = (st.game_points_p1 + st.game_points_p2 + 1);
+    entry.server_player = st.current_server;
+    entry.importance = point_importance(st);
+
+    int server = st.current_server;
+    int returner = (server==0?1:0);
+    int point_winner = -1;
+    bool rally = false;
+
+    // ---- Serve ----
+    switch (ev.serve) {
+    case 1: // 1st in
+        st.current_point_serve = SERVE_FIRST;
+        add_serve_attempt(st, server, SERVE_FIRST, true);
+        add_event(entry, "1st in; ");
+        break;
+    case 2: // 1st fault -> second
+        add_serve_attempt(st, server, SERVE_FIRST, false);
+        add_event(entry, "1st fault -> ");
+        st.current_point_serve = SERVE_SECOND;
+        if (ev.second==1) {
+            add_serve_attempt(st, server, SERVE_SECOND, true);
+            add_event(entry, "2nd in; ");
+        } else {
+            add_serve_attempt(st, server, SERVE_SECOND, false);
+            add_double_fault(st, server);
+            add_event(entry, "double fault.");
+            point_winner = returner;
+        }
+        break;
+    case 3: // 2nd in
+        st.current_point_serve = SERVE_SECOND;
+        add_serve_attempt(st, server, SERVE_SECOND, true);
+        add_event(entry, "2nd in; ");
+        break;
+    case 4: // DF
+        st.current_point_serve = SERVE_SECOND;
+        add_serve_attempt(st, server, SERVE_SECOND, false);
+        add_double_fault(st, server);
+        add_event(entry, "double fault.");
+        point_winner = returner;
+        break;
+    case 5: case 6: // Ace 1st / 2nd
+        st.current_point_serve = (ev.serve==5 ? SERVE_FIRST : SERVE_SECOND);
+        add_serve_attempt(st, server, st.current_point_serve, true);
+        add_ace(st, server, st.current_point_serve);
+        add_server_point_won(st, server, st.current_point_serve);
+        add_event(entry, (ev.serve==5 ? "Ace (1st)." : "Ace (2nd)."));
+        point_winner = server;
+        break;
+    default: // 7, 8: SW 1st / 2nd
+        st.current_point_serve = (ev.serve==7 ? SERVE_FIRST : SERVE_SECOND);
+        add_serve_attempt(st, server, st.current_point_serve, true);
+        add_service_winner(st, server, st.current_point_serve);
+        add_server_point_won(st, server, st.current_point_serve);
+        add_event(entry, (ev.serve==7 ? "Service winner (1st)." : "Service winner (2nd)."));
+        point_winner = server;
+        break;
+    }
+
+    // ---- Return ----
+    if (point_winner < 0) {
+        if (ev.ret==1) {
+            add_return_outcome(st, returner, "winner");
+            add_return_points_won(st, returner, st.current_point_serve);
+            add_event(entry, "Return winner.");
+            point_winner = returner;
+        } else if (ev.ret==2) {
+            add_return_outcome(st, returner, "ue");
+            add_server_point_won(st, server, st.current_point_serve);
+            add_event(entry, "Return UE.");
+            point_winner = server;
+        } else if (ev.ret==3) {
+            add_return_outcome(st, returner, "fe");
+            add_rally_outcome(st, server, "fedrawn");
+            add_server_point_won(st, server, st.current_point_serve);
+            add_event(entry, "Return FE (drawn by server).");
+            point_winner = server;
+        } else {
+            add_event(entry, "Return in; ");
+            rally = true;
+        }
+    }
+
+    // ---- Rally ----
+    if (rally) {
+        int rv = ev.rally;
+        if (rv==1){ add_rally_outcome(st, server, "winner"); add_server_point_won(st, server, st.current_point_serve); add_event(entry, "Rally: server winner."); point_winner=server; }
+        else if (rv==2){ add_rally_outcome(st, returner, "winner"); add_return_points_won(st, returner, st.current_point_serve); add_event(entry, "Rally: returner winner."); point_winner=returner; }
+        else if (rv==3){ add_rally_outcome(st, server, "ue"); add_return_points_won(st, returner, st.current_point_serve); add_event(entry, "Rally: server UE."); point_winner=returner; }
+        else if (rv==4){ add_rally_outcome(st, returner, "ue"); add_server_point_won(st, server, st.current_point_serve); add_event(entry, "Rally: returner UE."); point_winner=server; }
+        else if (rv==5){ add_rally_outcome(st, returner, "fedrawn"); add_return_points_won(st, returner, st.current_point_serve); add_event(entry, "Rally: server FE (drawn by returner)."); point_winner=returner; }
+        else { add_rally_outcome(st, server, "fedrawn"); add_server_point_won(st, server, st.current_point_serve); add_event(entry, "Rally: returner FE (drawn by server)."); point_winner=server; }
+    }
+
+    PlayerStats& mw = (point_winner==0? st.match_stats_p1 : st.match_stats_p2);
+    PlayerStats& ml = (point_winner==0? st.match_stats_p2 : st.match_stats_p1);
+    add_stats_point_ownership(mw, ml);
+
+    if (rally && ev.net_player >= 0) {
+        if (ev.net_player==0){ add_stats_net(st.match_stats_p1, point_winner==0); add_stats_net(st.per_set_stats_p1[st.current_set_index], point_winner==0); }
+        else { add_stats_net(st.match_stats_p2, point_winner==1); add_stats_net(st.per_set_stats_p2[st.current_set_index], point_winner==1); }
+    }
+
+    bool returner_won=(point_winner==returner);
+    maybe_count_break_point(st, was_break_point, returner_won);
+    count_point_importance(st, entry.importance, returner_won);
+
+    entry.serve_type = st.current_point_serve;
+    entry.point_winner = point_winner;
+    {
+        AllocSiteScope site(SITE_LOG);
+        st.log_entries.push_back(std::move(entry));
+    }
+    return point_winner;
+}
+
+// Records one point: undo snapshot, log entry, stats and score.
+static void apply_point_event(MatchState& st, const PointEvent& ev) {
+    push_history(st);
+    st.revision = ++last_revision;
+
+    // If in tiebreak, enforce correct server for THIS point.
+    if (st.in_set_tiebreak || st.in_match_tiebreak10) {
+        st.current_server = tiebreak_server(st);
+    }
+
+    int point_winner;
+    {
+        PhaseScope ps(PHASE_STATS);
+        point_winner = count_point_event(st, ev);
+    }
+    PhaseScope ps(PHASE_SCORING);
+    if (st.in_set_tiebreak) give_point_tiebreak(st, point_winner, true);
+    else if (st.in_match_tiebreak10) give_point_tiebreak(st, point_winner, false);
+    else give_point_regular(st, point_winner);
+}
+
+// =============== Synthetic matches ===============
+// Random but plausible point streams for load and scaling tests, fed
+// straight into apply_point_event. The generator first decides who wins the
+// point (from the server's strength), then picks menu keys that end it that
+// way, so every PointEvent is one a user could have typed. Pathological
+// matches steer the score into places hand-typed tests never reach: a deuce
+// game of 100+ points in set 1 and a 30-28 tiebreak in set 2.
+
+static uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Draw k of match m is a pure function of (seed, m, k).
+struct SimRng {
+    uint64_t key, ctr = 0;
+    SimRng(uint64_t seed, uint64_t match) : key(splitmix64(seed ^ splitmix64(match))) {}
+    uint64_t next() { return splitmix64(key + (ctr++) * 0x9E3779B97F4A7C15ULL); }
+};
+
+struct GenConfig {
+    double serve_rate[2] = {0.64, 0.62};  // share of service points won
+    double first_in = 0.62;    // first serves in
+    double ace_rate = 0.08;    // first serves in that are aces (a quarter of that on second serves)
+    double df_share = 0.2;     // second-serve points lost that are double faults
+    double ue_share = 0.35;    // rallies that end in an unforced error
+    double undo_rate = 0.0;    // chance of undoing each point right after it is played
+    bool pathological = false;
+};
+
+static const int GEN_DEUCE_GAME_POINTS = 104;   // forced length of the marathon deuce game
+static const int GEN_LONG_TB_POINTS = 56;       // tied this long, then 30-28
+static const long long GEN_MAX_UNDOS = 100000;  // per match; past this every point stands
+
+class MatchGenerator {
+public:
+    MatchGenerator(const GenConfig& cfg, uint64_t seed, uint64_t match) : cfg_(cfg), rng_(seed, match) {}
+
+    double uniform() { return (double)(rng_.next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    // The next point from the state as it stands.
+    PointEvent next(const MatchState& st) {
+        bool tb = st.in_set_tiebreak || st.in_match_tiebreak10;
+        int server = tb ? tiebreak_server(st) : st.current_server;
+        int winner = cfg_.pathological ? forced_winner(st, server) : -1;
+        if (winner < 0) winner = (uniform() < cfg_.serve_rate[server]) ? server : 1 - server;
+        return make_event(server, winner);
+    }
+
+private:
+    // -1 unless the pathological script wants a particular winner here.
+    int forced_winner(const MatchState& st, int server) const {
+        const SetScore& ss = st.sets[st.current_set_index];
+        int games = ss.games_player1 + ss.games_player2;
+        if (st.current_set_index == 0 && !st.in_set_tiebreak && games == 1) {
+            // Game 2 of set 1: level it point by point until the marathon is long enough
+            int p1 = st.game_points_p1, p2 = st.game_points_p2;
+            if (p1 + p2 >= GEN_DEUCE_GAME_POINTS) return -1;
+            if (p1 != p2) return p1 < p2 ? 0 : 1;
+            return (p1 + p2) % 4 == 0 ? 0 : 1;
+        }
+        if (st.current_set_index == 1 && !st.in_match_tiebreak10) {
+            if (!st.in_set_tiebreak) return server;   // holds all the way to the tiebreak
+            int a = st.tb_points_p1, b = st.tb_points_p2;
+            if (a + b >= GEN_LONG_TB_POINTS) return 0;
+            return a <= b ? 0 : 1;
+        }
+        return -1;
+    }
+
+    PointEvent make_event(int server, int winner) {
+        PointEvent ev;
+        bool first = uniform() < cfg_.first_in;
+        double u = uniform();
+        if (winner == server) {
+            double ace = first ? cfg_.ace_rate : cfg_.ace_rate / 4;
+            if (u < ace) { ev.serve = first ? 5 : 6; return ev; }
+            if (u < ace * 1.6) { ev.serve = first ? 7 : 8; return ev; }
+            serve_in(ev, first);
+            u = uniform();
+            if (u < 0.12) { ev.ret = (u < 0.12 * cfg_.ue_share) ? 2 : 3; return ev; }
+            ev.ret = 4;
+            u = uniform();
+            ev.rally = (u < cfg_.ue_share) ? 4 : (u < cfg_.ue_share + 0.25 ? 6 : 1);
+        } else {
+            if (!first && u < cfg_.df_share) { ev.serve = 2; ev.second = 2; return ev; }
+            serve_in(ev, first);
+            if (uniform() < 0.06) { ev.ret = 1; return ev; }
+            ev.ret = 4;
+            u = uniform();
+            ev.rally = (u < cfg_.ue_share) ? 3 : (u < cfg_.ue_share + 0.25 ? 5 : 2);
+        }
+        if (uniform() < 0.1) ev.net_player = (uniform() < 0.65) ? winner : 1 - winner;
+        return ev;
+    }
+
+    static void serve_in(PointEvent& ev, bool first) {
+        if (first) ev.serve = 1;
+        else { ev.serve = 2; ev.second = 1; }
+    }
+
+    const GenConfig& cfg_;
+    SimRng rng_;
+};
+
+// =============== Benchmarks ===============
+// Built with -DTENNIS_BENCH this file is a microbenchmark binary instead of
+// the tracker. Each hot path runs on generated matches of a few lengths and
+// is reported as ns/op, allocations/op and bytes allocated/op, using the
+// allocation counters from the Instrumentation section.
+#ifdef TENNIS_BENCH
+
+static const double BENCH_MIN_SECONDS = 0.2;   // per benchmark, after one warm-up call
+
+// Hardware counters read around each benchmark loop, user space only, as one
+// perf_event_open group so they all cover the same instructions. Where the
+// kernel refuses (containers, perf_event_paranoid, no PMU in the VM) the
+// columns show "--" and the timings are unaffected.
+enum BenchCounter { CTR_CYCLES, CTR_INSTRUCTIONS, CTR_BRANCH_MISSES, CTR_CACHE_MISSES, CTR_COUNT };
+
+class PerfCounters {
+public:
+    PerfCounters() {
+        for (int c = 0; c < CTR_COUNT; c++) fd_[c] = -1;
+#ifdef HAVE_PERF_EVENTS
+        static const uint64_t configs[CTR_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES };
+        int first_error = 0;
+        for (int c = 0; c < CTR_COUNT; c++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[c];
+            attr.disabled = (leader_ < 0);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0);
+            if (fd < 0) { if (!first_error) first_error = errno; continue; }
+            if (leader_ < 0) leader_ = fd;
+            fd_[c] = fd;
+            order_[members_++] = c;
+        }
+        if (first_error)
+            cerr << "perf_event_open: " << strerror(first_error) << "; missing counters show --\n";
+#endif
+    }
+
+    ~PerfCounters() {
+        for (int c = 0; c < CTR_COUNT; c++) if (fd_[c] >= 0) close(fd_[c]);
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    void start() {
+#ifdef HAVE_PERF_EVENTS
+        if (leader_ < 0) return;
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    // Counts since start(), scaled up if the group was multiplexed;
+    // -1 for counters that could not be opened.
+    void stop(double out[CTR_COUNT]) {
+        for (int c = 0; c < CTR_COUNT; c++) out[c] = -1;
+#ifdef HAVE_PERF_EVENTS
+        if (leader_ < 0) return;
+        ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t buf[3 + CTR_COUNT];
+        if (read(leader_, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t))) return;
+        if (buf[2] == 0) return;   // never got scheduled on the PMU
+        double scale = (double)buf[1] / (double)buf[2];
+        for (uint64_t i = 0; i < buf[0] && i < (uint64_t)members_; i++)
+            out[order_[i]] = (double)buf[3 + i] * scale;
+#endif
+    }
+
+private:
+    int fd_[CTR_COUNT];
+    int order_[CTR_COUNT];   // counter behind each value of a group read
+    int members_ = 0;
+    int leader_ = -1;
+};
+
+static PerfCounters& bench_counters() {
+    static PerfCounters counters;
+    return counters;
+}
+
+// A generated match: the events in order, and the state before the first
+// point, before the last one and after all of them.
+struct BenchMatch {
+    const char* name;
+    MatchState start, before_last, end;
+    vector<PointEvent> events;
+};
+
+static void bench_build_match(BenchMatch& m, const char* name, int format_choice, bool pathological, uint64_t seed) {
+    GenConfig cfg;
+    cfg.pathological = pathological;
+    MatchGenerator gen(cfg, seed, 0);
+    m.name = name;
+    MatchState& st = m.start;
+    st.player1_name = "Bench A";
+    st.player2_name = "Bench B";
+    st.location = "Bench";
+    st.format = get_format_by_choice(format_choice);
+    st.sets_to_win = 2;
+    st.current_server = (gen.uniform() < 0.5) ? 0 : 1;
+    start_new_set(st);
+    m.end = st;
+    while (!match_is_over_now(m.end)) {
+        if (m.end.in_match_tiebreak10 && m.end.tb_points_p1==0 && m.end.tb_points_p2==0)
+            m.end.tb_start_server = m.end.current_server;
+        m.before_last = m.end;
+        m.events.push_back(gen.next(m.end));
+        apply_point_event(m.end, m.events.back());
+    }
+    history_stack.clear();
+}
+
+static const int BENCH_COURTS = 1024;   // for the court sweeps
+
+// What a sweep over every live court reads from each: the score core only.
+static int bench_core_digest(const ScoreCore& c) {
+    return c.sets_won_p1 * 4096 + c.sets_won_p2 * 1024 + c.game_points_p1 * 64 + c.game_points_p2 * 16
+         + c.tb_points_p1 + c.tb_points_p2 + c.current_server;
+}
+
+// Calls body() until BENCH_MIN_SECONDS have passed and prints one row;
+// each call counts as ops_per_call operations. The hardware counters cover
+// the same calls as the timing.
+template <class F>
+static void bench_run(const char* what, const BenchMatch& m, long long ops_per_call, F body) {
+    body();
+    long long calls = 0;
+    long long a0 = alloc_count_total.load(), b0 = alloc_bytes_total.load();
+    bench_counters().start();
+    auto t0 = chrono::steady_clock::now();
+    double secs = 0;
+    do {
+        body();
+        calls++;
+        secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    } while (secs < BENCH_MIN_SECONDS);
+    double counts[CTR_COUNT];
+    bench_counters().stop(counts);
+    double ops = (double)calls * ops_per_call;
+
+    OutBuf& b = scratch_buffer();
+    size_t start = b.data.size();
+    b << what; pad_from(b, start, 34);
+    start = b.data.size(); b << m.name; pad_from(b, start, 10);
+    start = b.data.size(); b << (long long)m.events.size(); pad_from(b, start, 8);
+    start = b.data.size(); b << Fixed{secs * 1e9 / ops, 1}; pad_from(b, start, 12);
+    start = b.data.size(); b << Fixed{(alloc_count_total.load() - a0) / ops, 2}; pad_from(b, start, 12);
+    start = b.data.size(); b << Fixed{(alloc_bytes_total.load() - b0) / ops, 1}; pad_from(b, start, 12);
+    for (int c = 0; c < CTR_COUNT; c++) {
+        start = b.data.size();
+        if (counts[c] < 0) b << "--";
+        else b << Fixed{counts[c] / ops, 1};
+        if (c + 1 < CTR_COUNT) pad_from(b, start, 12);
+    }
+    b << '\n';
+    write_stdout(b);
+    cout.flush();
+}
+
+int main() {
+    ios::sync_with_stdio(false);
+    static BenchMatch matches[3];
+    bench_build_match(matches[0], "short", 3, false, 1);
+    bench_build_match(matches[1], "full", 1, false, 6);
+    bench_build_match(matches[2], "marathon", 1, true, 1);
+
+    cout << "benchmark                         match     points  ns/op       allocs/op   bytes/op    "
+            "cycles/op   instr/op    br-miss/op  cache-miss/op\n";
+    for (const BenchMatch& m : matches) {
+        // Whole match through apply_point_event (includes its undo snapshot); op = one point
+        bench_run("apply_point_event", m, (long long)m.events.size(), [&]{
+            MatchState st = m.start;
+            for (const PointEvent& ev : m.events) apply_point_event(st, ev);
+            history_stack.clear();
+        });
+        // op = one push_history + pop_history pair on the finished match
+        MatchState st = m.end;
+        bench_run("push_history+pop_history", m, 1, [&]{
+            push_history(st);
+            pop_history(st);
+        });
+        // Both players side by side, formatted from scratch
+        bench_run("side-by-side stats (cold)", m, 1, [&]{
+            CachedStatsView v;
+            const PlayerStats* cols[2] = { &m.end.match_stats_p1, &m.end.match_stats_p2 };
+            refresh_stats_view(v, 1, SIDE_BY_SIDE_LINES, SIDE_BY_SIDE_LINE_COUNT, cols, 2);
+        });
+        // The cached view brought forward (or back) by the match's last
+        // point: only the cells that point changed are redone
+        CachedStatsView warm;
+        uint64_t rev = 0;
+        bench_run("side-by-side stats (one point)", m, 2, [&]{
+            const PlayerStats* before[2] = { &m.before_last.match_stats_p1, &m.before_last.match_stats_p2 };
+            const PlayerStats* after[2] = { &m.end.match_stats_p1, &m.end.match_stats_p2 };
+            refresh_stats_view(warm, ++rev, SIDE_BY_SIDE_LINES, SIDE_BY_SIDE_LINE_COUNT, before, 2);
+            refresh_stats_view(warm, ++rev, SIDE_BY_SIDE_LINES, SIDE_BY_SIDE_LINE_COUNT, after, 2);
+        });
+        bench_run("CSV exports (3 files)", m, 1, [&]{
+            OutBuf& b = scratch_buffer();
+            render_totals_csv(b, m.end);
+            render_per_set_csv(b, m.end);
+            render_points_csv(b, m.end);
+        });
+        bench_run("JSON export", m, 1, [&]{
+            OutBuf& b = scratch_buffer();
+            render_match_json(b, m.end);
+        });
+        bench_run("TXT export", m, 1, [&]{
+            OutBuf& b = scratch_buffer();
+            render_match_txt(b, m.end);
+        });
+    }
+
+    // One core read per court. The court server gives each court its own
+    // MatchState, so the cores sit one cache line each among the courts'
+    // logs and names; the second row packs the same cores into one array.
+    const BenchMatch& m = matches[1];
+    vector<unique_ptr<MatchState>> courts;
+    vector<ScoreCore> cores;
+    for (int i = 0; i < BENCH_COURTS; i++) {
+        courts.emplace_back(new MatchState(m.end));
+        cores.push_back(m.end);
+    }
+    volatile int sink = 0;
+    bench_run("court sweep, separate MatchStates", m, BENCH_COURTS, [&]{
+        int d = 0;
+        for (const unique_ptr<MatchState>& c : courts) d += bench_core_digest(*c);
+        sink = d;
+    });
+    bench_run("court sweep, ScoreCore array", m, BENCH_COURTS, [&]{
+        int d = 0;
+        for (const ScoreCore& c : cores) d += bench_core_digest(c);
+        sink = d;
+    });
+    (void)sink;
+    return 0;
+}
+
+#endif // TENNIS_BENCH
+
+// =============== Tracker ===============
+// Everything from here on is the interactive tracker and its servers and
+// exporters; the bench build stops above.
+#ifndef TENNIS_BENCH
+
+// =============== Small helpers ===============
+
+static string now_date_time_string() {
+    time_t t = time(nullptr);
+    tm lt;
+    localtime_r(&t, &lt);   // export pool threads read the clock too
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%d_%H-%M-%S", &lt);
+    return string(buf);
+}
+
+static string left_pad(const string& s, int width) {
+    if ((int)s.size() >= width) return s;
+    return string(width - (int)s.size(), ' ') + s;
+}
+
+static string right_pad(const string& s, int width) {
+    if ((int)s.size() >= width) return s;
+    return s + string(width - (int)s.size(), ' ');
+}
+
+static bool write_whole_file(const string& path, const OutBuf& b) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    setvbuf(f, nullptr, _IONBF, 0);
+    bool ok = fwrite(b.data.data(), 1, b.data.size(), f) == b.data.size();
+    return (fclose(f) == 0) && ok;
+}
+
+// =============== Terminal ===============
+// Capabilities are probed once; getenv/isatty/ioctl are not free and the
+// scoreboard asks for them several times per point.
+
+struct TermCaps {
+    bool color = false;    // TERM looks like it understands SGR colors
+    bool ansi = false;     // cursor addressing and scroll regions work
+    bool tty = false;      // stdout is a terminal
+};
+
+static const TermCaps& term_caps() {
+    static const TermCaps caps = []{
+        TermCaps c;
+        const char* term = getenv("TERM");
+        string t(term ? term : "");
+        // Optional color (safe fallback)
+        c.color = (t.find("xterm") != string::npos || t.find("color") != string::npos);
+        c.ansi = !t.empty() && t != "dumb";
+        c.tty = isatty(STDOUT_FILENO);
+        return c;
+    }();
+    return caps;
+}
+
+static int terminal_rows() {
+    winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0) return ws.ws_row;
+    return 24;
+}
+
+// Raw (non-canonical, no echo) input for --keys: every menu answer is one
+// keypress, no Enter. The original terminal settings come back at exit and
+// on fatal signals.
+static termios saved_termios;
+static bool raw_mode_on = false;
+
+static void leave_raw_mode() {
+    if (!raw_mode_on) return;
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_termios);
+    raw_mode_on = false;
+}
+
+static void raw_mode_signal(int sig) {
+    leave_raw_mode();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static bool enter_raw_mode() {
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved_termios) != 0) return false;
+    termios raw = saved_termios;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) != 0) return false;
+    raw_mode_on = true;
+    atexit(leave_raw_mode);
+    signal(SIGINT, raw_mode_signal);
+    signal(SIGTERM, raw_mode_signal);
+    signal(SIGHUP, raw_mode_signal);
+    return true;
+}
+
+// Reads one menu answer. Line mode parses a number as before; raw mode takes
+// the next digit key, echoes it and returns immediately (other keys are
+// ignored). Returns 0 at end of input in raw mode.
+// Blocks until stdin has something to read, so the time a person spends
+// deciding is not counted as input handling.
+static void wait_for_input() {
+    if (cin.rdbuf()->in_avail() > 0) return;
+    pollfd p = { STDIN_FILENO, POLLIN, 0 };
+    while (poll(&p, 1, -1) < 0 && errno == EINTR) {}
+}
+
+static int read_choice() {
+    {
+        PhaseScope ps(PHASE_RENDER);
+        cout.flush();
+    }
+    wait_for_input();
+    PhaseScope ps(PHASE_INPUT);
+    if (!raw_mode_on) {
+        int v; cin>>v;
+        return v;
+    }
+    for (;;) {
+        int ch = cin.get();
+        if (ch == EOF) return 0;
+        if (ch >= '0' && ch <= '9') {
+            cout << (char)ch << "\n";
+            return ch - '0';
+        }
+    }
+}
+
+static const char* const SERVE_DOT = "●";
+
+static string green_dot() {
+    if (term_caps().color) return string("\033[1;32m") + SERVE_DOT + "\033[0m";
+    return SERVE_DOT;
+}
+
+// =============== Printing ===============
+
+// P(player 1 wins the match), from the match totals so far.
+static double match_win_probability(const MatchState& st) {
+    return win_prob_model_for(st).player1_wins(st);
+}
+
+static string tennis_point_to_string(int p) {
+    if (p <= 0) return "0";
+    if (p == 1) return "15";
+    if (p == 2) return "30";
+    if (p >= 3) return "40";
+    return "0";
+}
+
+static void compute_tiebreak_server(MatchState& st) {
+    int total = st.tb_points_p1 + st.tb_points_p2;
+    st.current_server = tiebreak_server(st);
+
+    // Change ends every 6 points -> we just print a cue when needed (after last point),
+    // the user will see it before entering next point.
+    if (total>0 && total%6==0) {
+        cout << "\n--- Change ends (tiebreak, after " << total << " points) ---\n";
+    }
+}
+
+// Points column of the scoreboard: TB count, or 0/15/30/40/Ad.
+static void point_strings(const ScoreCore& st, string& pts1, string& pts2) {
+    if (st.in_set_tiebreak || st.in_match_tiebreak10) {
+        pts1 = to_string(st.tb_points_p1);
+        pts2 = to_string(st.tb_points_p2);
+    } else {
+        if (st.game_points_p1 >= 3 && st.game_points_p2 >= 3) {
+            if (st.game_points_p1 == st.game_points_p2) { pts1="40"; pts2="40"; }
+            else if (st.game_points_p1 == st.game_points_p2 + 1) { pts1="Ad"; pts2=""; }
+            else if (st.game_points_p2 == st.game_points_p1 + 1) { pts1=""; pts2="Ad"; }
+            else { pts1=tennis_point_to_string(st.game_points_p1); pts2=tennis_point_to_string(st.game_points_p2); }
+        } else {
+            pts1 = tennis_point_to_string(st.game_points_p1);
+            pts2 = tennis_point_to_string(st.game_points_p2);
+        }
+    }
+}
+
+static const int SCOREBOARD_ROWS = 8;
+
+// The scoreboard box as plain text rows; the serve dot is colored when the
+// rows are written out, so these can be compared cell by cell.
+static void build_scoreboard_frame(const MatchState& st, vector<string>& rows) {
+    const string& p1 = st.player1_name;
+    const string& p2 = st.player2_name;
+
+    // Serving dot before the server's name
+    string name1 = (st.current_server==0 ? (SERVE_DOT + string(" ") + p1) : ("  " + p1));
+    string name2 = (st.current_server==1 ? (SERVE_DOT + string(" ") + p2) : ("  " + p2));
+
+    int g1 = st.sets[st.current_set_index].games_player1;
+    int g2 = st.sets[st.current_set_index].games_player2;
+
+    string pts1, pts2;
+    point_strings(st, pts1, pts2);
+
+    rows.resize(SCOREBOARD_ROWS);
+    rows[0] = "+--------------------------------------------------+";
+    rows[1] = "| Location: " + right_pad(st.location, 40) + "|";
+    rows[2] = "| " + right_pad(name1, 22) + "| " + right_pad(name2, 15) + "|";
+    rows[3] = "| Sets:           " + left_pad(to_string(st.sets_won_p1), 10)
+            + "  | " + left_pad(to_string(st.sets_won_p2), 10) + "|";
+    rows[4] = "| Games:          " + left_pad(to_string(g1), 10)
+            + "  | " + left_pad(to_string(g2), 10) + "|";
+    rows[5] = "| Points:         " + left_pad(pts1, 10)
+            + "  | " + left_pad(pts2, 10) + "|";
+    // Win chances in per-mille, so the two always add up to 100.0%
+    int win1 = (int)(match_win_probability(st) * 1000 + 0.5);
+    char w1[FORMAT_BUF], w2[FORMAT_BUF];
+    int n1 = format_percent(w1, win1, 1000), n2 = format_percent(w2, 1000 - win1, 1000);
+    rows[6] = "| Win chance:     " + left_pad(string(w1, n1), 10)
+            + "  | " + left_pad(string(w2, n2), 10) + "|";
+    rows[7] = "+--------------------------------------------------+";
+}
+
+// Splits a row into one string per screen column (UTF-8 aware).
+static void split_cells(const string& row, vector<string>& cells) {
+    cells.clear();
+    for (size_t i=0;i<row.size();) {
+        size_t n = 1;
+        unsigned char c = (unsigned char)row[i];
+        if (c >= 0xF0) n = 4; else if (c >= 0xE0) n = 3; else if (c >= 0xC0) n = 2;
+        cells.push_back(row.substr(i, n));
+        i += n;
+    }
+}
+
+static void append_cell(string& out, const string& cell) {
+    if (cell == SERVE_DOT) out += green_dot();
+    else out += cell;
+}
+
+// Keeps the last frame drawn. In pinned mode (a real ANSI terminal) the box
+// lives in the top rows, everything else scrolls in a region below it, and
+// each render rewrites only the cells that changed, with cursor moves, in a
+// single write. Otherwise the box is printed inline as before.
+class ScoreboardRenderer {
+public:
+    void enable_pinned() {
+        if (!term_caps().tty || !term_caps().ansi) return;
+        pinned_ = true;
+        prev_.clear();
+        signal(SIGWINCH, on_winch);
+    }
+
+    bool pinned() const { return pinned_; }
+
+    void render(const vector<string>& rows) {
+        if (!pinned_) {
+            for (const auto& r : rows) {
+                split_cells(r, scratch_);
+                string line;
+                for (const auto& c : scratch_) append_cell(line, c);
+                cout << line << "\n";
+            }
+            return;
+        }
+
+        string out;
+        bool full = prev_.empty() || resized_;
+        if (full) {
+            resized_ = false;
+            term_rows_ = terminal_rows();
+            prev_.assign(rows.size(), vector<string>());
+            // Clear, reserve the top rows, and park the cursor at the bottom
+            // of the scrolling region below them.
+            out += "\0337\033[r\033[H\033[2J";
+            out += "\033[" + to_string(SCOREBOARD_ROWS + 1) + ";" + to_string(term_rows_) + "r";
+        } else {
+            out += "\0337";
+        }
+        size_t before = out.size();
+        for (size_t r=0;r<rows.size();r++) {
+            split_cells(rows[r], scratch_);
+            vector<string>& old = prev_[r];
+            size_t width = max(scratch_.size(), old.size());
+            size_t c = 0;
+            while (c < width) {
+                if (c < scratch_.size() && c < old.size() && scratch_[c] == old[c]) { c++; continue; }
+                size_t run_end = c;
+                while (run_end < width && !(run_end < scratch_.size() && run_end < old.size() && scratch_[run_end] == old[run_end])) run_end++;
+                out += "\033[" + to_string(r+1) + ";" + to_string(c+1) + "H";
+                for (size_t k=c;k<run_end;k++) {
+                    if (k < scratch_.size()) append_cell(out, scratch_[k]);
+                    else out += ' ';   // row got shorter
+                }
+                c = run_end;
+            }
+            old = scratch_;
+        }
+        if (full) out += "\033[" + to_string(term_rows_) + ";1H";
+        else if (out.size() == before) return;   // nothing changed, write nothing
+        else out += "\033[0m\0338";
+        cout.flush();
+        write_all(out);
+    }
+
+    // Gives the whole screen back to normal scrolling.
+    void shutdown() {
+        if (!pinned_) return;
+        pinned_ = false;
+        cout.flush();
+        write_all("\033[r\033[" + to_string(terminal_rows()) + ";1H\n");
+    }
+
+private:
+    static void on_winch(int) { resized_ = true; }
+
+    static void write_all(const string& s) {
+        size_t off = 0;
+        while (off < s.size()) {
+            ssize_t n = write(STDOUT_FILENO, s.data() + off, s.size() - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            off += (size_t)n;
+        }
+    }
+
+    bool pinned_ = false;
+    int term_rows_ = 24;
+    vector<vector<string>> prev_;
+    vector<string> scratch_;
+    static volatile sig_atomic_t resized_;
+};
+
+volatile sig_atomic_t ScoreboardRenderer::resized_ = 0;
+
+static ScoreboardRenderer& scoreboard_renderer() {
+    static ScoreboardRenderer r;
+    return r;
+}
+
+static void print_scoreboard(const MatchState& st) {
+    PhaseScope ps(PHASE_RENDER);
+    static vector<string> rows;
+    build_scoreboard_frame(st, rows);
+    scoreboard_renderer().render(rows);
+}
+
+// =============== Stats screens ===============
+
+static int stats_view_key(int set_idx, int who) { return (set_idx + 1) * 4 + who; }
+
+static const PlayerStats& stats_for(const MatchState& st, int set_idx, int player) {
+    if (set_idx < 0) return player == 0 ? st.match_stats_p1 : st.match_stats_p2;
+    return player == 0 ? st.per_set_stats_p1[set_idx] : st.per_set_stats_p2[set_idx];
+}
+
+// One player's stats (set_idx -1 = match totals) under the given title.
+static void show_player_stats(const MatchState& st, int set_idx, int player, const string& title) {
+    CachedStatsView& v = stats_view_cache[stats_view_key(set_idx, player)];
+    const PlayerStats* cols[1] = { &stats_for(st, set_idx, player) };
+    refresh_stats_view(v, st.revision, SINGLE_PLAYER_LINES, SINGLE_PLAYER_LINE_COUNT, cols, 1);
+    OutBuf& o = scratch_buffer();
+    o << title << '\n' << "----------------------------------------\n" << v.body;
+    write_stdout(o);
+}
+
+// Both players side by side (set_idx -1 = match totals).
+static void show_both_stats(const MatchState& st, int set_idx) {
+    CachedStatsView& v = stats_view_cache[stats_view_key(set_idx, 2)];
+    const PlayerStats* cols[2] = { &stats_for(st, set_idx, 0), &stats_for(st, set_idx, 1) };
+    refresh_stats_view(v, st.revision, SIDE_BY_SIDE_LINES, SIDE_BY_SIDE_LINE_COUNT, cols, 2);
+    const int L = SIDE_BY_SIDE_WIDTH;
+    OutBuf& o = scratch_buffer();
+    size_t start = o.data.size();
+    o << st.player1_name; pad_from(o, start, L);
+    o << "   ";
+    start = o.data.size();
+    o << st.player2_name; pad_from(o, start, L);
+    o << '\n';
+    o.data.append(L, '-'); o << "   "; o.data.append(L, '-'); o << '\n';
+    o << v.body;
+    write_stdout(o);
+}
+
+// =============== Archive loading ===============
+// Reads back the .json files written above so a whole archive can be
+// re-exported (--reexport). Only what our own exporter writes needs to
+// parse, but the reader is a plain recursive-descent JSON parser.
+
+struct JsonValue {
+    enum Kind { J_NULL, J_BOOL, J_NUM, J_STR, J_ARR, J_OBJ };
+    Kind kind = J_NULL;
+    bool b = false;
+    double num = 0;
+    string str;
+    vector<JsonValue> items;
+    vector<pair<string, JsonValue>> fields;
+
+    const JsonValue* get(const char* key) const {
+        for (const auto& f : fields) if (f.first == key) return &f.second;
+        return nullptr;
+    }
+};
+
+class JsonReader {
+public:
+    JsonReader(const char* p, const char* end) : p_(p), end_(end) {}
+
+    bool parse(JsonValue& v) {
+        if (!value(v, 0)) return false;
+        ws();
+        return p_ == end_;
+    }
+
+private:
+    void ws() { while (p_ < end_ && (*p_==' ' || *p_=='\n' || *p_=='\r' || *p_=='\t')) p_++; }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if ((size_t)(end_ - p_) < n || memcmp(p_, word, n) != 0) return false;
+        p_ += n;
+        return true;
+    }
+
+    bool string_body(string& out) {
+        p_++; // opening quote
+        while (p_ < end_ && *p_ != '"') {
+            char c = *p_++;
+            if (c != '\\') { out.push_back(c); continue; }
+            if (p_ >= end_) return false;
+            char e = *p_++;
+            if (e=='n') out.push_back('\n');
+            else if (e=='t') out.push_back('\t');
+            else if (e=='r') out.push_back('\r');
+            else if (e=='u') {
+                if (end_ - p_ < 4) return false;
+                unsigned cp = (unsigned)strtoul(string(p_, 4).c_str(), nullptr, 16);
+                p_ += 4;
+                if (cp < 0x80) out.push_back((char)cp);
+                else if (cp < 0x800) { out.push_back((char)(0xC0 | (cp>>6))); out.push_back((char)(0x80 | (cp&0x3F))); }
+                else { out.push_back((char)(0xE0 | (cp>>12))); out.push_back((char)(0x80 | ((cp>>6)&0x3F))); out.push_back((char)(0x80 | (cp&0x3F))); }
+            }
+            else out.push_back(e);   // \" \\ \/
+        }
+        if (p_ >= end_) return false;
+        p_++;
+        return true;
+    }
+
+    bool value(JsonValue& v, int depth) {
+        if (depth > 64) return false;
+        ws();
+        if (p_ >= end_) return false;
+        char c = *p_;
+        if (c == '{') {
+            v.kind = JsonValue::J_OBJ;
+            p_++; ws();
+            if (p_ < end_ && *p_ == '}') { p_++; return true; }
+            for (;;) {
+                ws();
+                if (p_ >= end_ || *p_ != '"') return false;
+                v.fields.emplace_back();
+                if (!string_body(v.fields.back().first)) return false;
+                ws();
+                if (p_ >= end_ || *p_ != ':') return false;
+                p_++;
+                if (!value(v.fields.back().second, depth+1)) return false;
+                ws();
+                if (p_ < end_ && *p_ == ',') { p_++; continue; }
+                if (p_ < end_ && *p_ == '}') { p_++; return true; }
+                return false;
+            }
+        }
+        if (c == '[') {
+            v.kind = JsonValue::J_ARR;
+            p_++; ws();
+            if (p_ < end_ && *p_ == ']') { p_++; return true; }
+            for (;;) {
+                v.items.emplace_back();
+                if (!value(v.items.back(), depth+1)) return false;
+                ws();
+                if (p_ < end_ && *p_ == ',') { p_++; continue; }
+                if (p_ < end_ && *p_ == ']') { p_++; return true; }
+                return false;
+            }
+        }
+        if (c == '"') { v.kind = JsonValue::J_STR; return string_body(v.str); }
+        if (literal("true")) { v.kind = JsonValue::J_BOOL; v.b = true; return true; }
+        if (literal("false")) { v.kind = JsonValue::J_BOOL; v.b = false; return true; }
+        if (literal("null")) { v.kind = JsonValue::J_NULL; return true; }
+        char* num_end = nullptr;
+        v.num = strtod(p_, &num_end);
+        if (num_end == p_ || num_end > end_) return false;
+        v.kind = JsonValue::J_NUM;
+        p_ = num_end;
+        return true;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+static bool read_whole_file(const string& path, string& out) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char buf[65536];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Numbers outside int range are clamped to it; NaN counts as missing.
+static int json_int(const JsonValue* v, int def=0) {
+    if (!v || v->kind!=JsonValue::J_NUM || v->num != v->num) return def;
+    if (v->num <= (double)INT_MIN) return INT_MIN;
+    if (v->num >= (double)INT_MAX) return INT_MAX;
+    return (int)v->num;
+}
+static bool json_bool(const JsonValue* v) { return v && v->kind==JsonValue::J_BOOL && v->b; }
+static string json_str(const JsonValue* v) { return (v && v->kind==JsonValue::J_STR) ? v->str : string(); }
+
+static void json_stats(const JsonValue* v, PlayerStats& ps) {
+    if (!v || v->kind != JsonValue::J_ARR) return;
+    for (int i=0;i<STAT_FIELD_COUNT && i<(int)v->items.size();i++) ps.*STAT_FIELDS[i] = json_int(&v->items[i]);
+}
+
+// Rebuilds the exportable part of a MatchState from one of our .json files.
+// Files written before per-player stats were exported load with zero stats.
+static bool load_match_json(const string& path, MatchState& st) {
+    string text;
+    if (!read_whole_file(path, text)) return false;
+    JsonValue root;
+    JsonReader rd(text.data(), text.data() + text.size());
+    if (!rd.parse(root) || root.kind != JsonValue::J_OBJ) return false;
+
+    const JsonValue* players = root.get("players");
+    if (!players || players->items.size() != 2) return false;
+    st.player1_name = json_str(&players->items[0]);
+    st.player2_name = json_str(&players->items[1]);
+    st.location = json_str(root.get("location"));
+
+    // Every file we write has a format; without one the scores mean nothing
+    const JsonValue* f = root.get("format");
+    if (!f || f->kind != JsonValue::J_OBJ) return false;
+    st.format.games_to_win_set = json_int(f->get("games_to_win_set"), 6);
+    st.format.tiebreak_at_games = json_int(f->get("tiebreak_at_games"), 6);
+    st.format.set_tiebreak_points = json_int(f->get("set_tiebreak_points"), 7);
+    st.format.deciding = json_bool(f->get("deciding_tb10")) ? DECIDING_TB10 : DECIDING_REGULAR;
+    st.format.deciding_tb_points = 10;
+
+    if (const JsonValue* sets = root.get("sets")) {
+        for (const JsonValue& sv : sets->items) {
+            SetScore s;
+            s.games_player1 = json_int(sv.get("p1"));
+            s.games_player2 = json_int(sv.get("p2"));
+            s.set_tiebreak_played = json_bool(sv.get("tb"));
+            s.tb_points_p1 = json_int(sv.get("tb_p1"));
+            s.tb_points_p2 = json_int(sv.get("tb_p2"));
+            s.set_finished = true;
+            st.sets.push_back(s);
+        }
+    }
+    if (st.sets.empty()) st.sets.push_back(SetScore());
+    st.current_set_index = (int)st.sets.size()-1;
+    st.per_set_stats_p1.assign(st.sets.size(), PlayerStats());
+    st.per_set_stats_p2.assign(st.sets.size(), PlayerStats());
+
+    if (const JsonValue* stats = root.get("stats")) {
+        json_stats(stats->get("p1"), st.match_stats_p1);
+        json_stats(stats->get("p2"), st.match_stats_p2);
+        const JsonValue* s1 = stats->get("sets_p1");
+        const JsonValue* s2 = stats->get("sets_p2");
+        for (size_t i=0;i<st.sets.size();i++) {
+            if (s1 && i < s1->items.size()) json_stats(&s1->items[i], st.per_set_stats_p1[i]);
+            if (s2 && i < s2->items.size()) json_stats(&s2->items[i], st.per_set_stats_p2[i]);
+        }
+    }
+
+    if (const JsonValue* log = root.get("log")) {
+        st.log_entries.reserve(log->items.size());
+        for (const JsonValue& lv : log->items) {
+            PointLogEntry e;
+            e.set_index = json_int(lv.get("set"), 1) - 1;
+            e.game_index = json_int(lv.get("game"), 1) - 1;
+            e.in_tiebreak = json_bool(lv.get("tb"));
+            e.server_player = (json_str(lv.get("server")) == "P2") ? 1 : 0;
+            string t = json_str(lv.get("serve_type"));
+            e.serve_type = (t=="1st" ? SERVE_FIRST : (t=="2nd" ? SERVE_SECOND : SERVE_NONE));
+            e.point_winner = (json_str(lv.get("winner")) == "P2") ? 1 : 0;
+            e.was_break_point = json_bool(lv.get("bp"));
+            e.was_game_point = json_bool(lv.get("gp"));
+            e.was_set_point = json_bool(lv.get("sp"));
+            e.was_match_point = json_bool(lv.get("mp"));
+            if (const JsonValue* imp = lv.get("importance")) e.importance = imp->num;
+            e.event_chain = json_str(lv.get("event"));
+            st.log_entries.push_back(std::move(e));
+        }
+    }
+    return true;
+}
+
+// =============== Player database ===============
+// --players FILE keeps career records for everyone who finishes a match
+// here. Names are interned to small ids. The moment a match ends, it is
+// folded into each player's career, season (calendar year) and surface
+// aggregates: under a lock the file is read, the match added and the file
+// replaced. A career view (--career NAME) reads only those aggregates and
+// never rescans old matches. The file is plain text, one aggregate per line:
+//
+//   player ID NAME
+//   career ID COUNTS...
+//   season ID YEAR COUNTS...
+//   surface ID SURFACE COUNTS...
+//
+// COUNTS are the CAREER_FIELDS below. Then come the summed PlayerStats for
+// whole matches and for set 1 to CAREER_MAX_SETS, in STAT_FIELDS order.
+
+enum Surface { SURFACE_HARD, SURFACE_CLAY, SURFACE_GRASS, SURFACE_CARPET, SURFACE_COUNT };
+static const char* const SURFACE_NAMES[SURFACE_COUNT] = { "hard", "clay", "grass", "carpet" };
+static const int CAREER_MAX_SETS = 5;
+static const char* const PLAYER_DB_HEADER = "tennistracker-players 1";
+
+struct CareerRecord {
+    int matches=0, matches_won=0;
+    int sets=0, sets_won=0;
+    int games=0, games_won=0;
+    int service_games=0, service_games_held=0;
+    int return_games=0, return_games_won=0;
+    int tiebreaks=0, tiebreaks_won=0;
+    PlayerStats stats;                      // match totals, summed
+    PlayerStats by_set[CAREER_MAX_SETS];    // set 1, set 2, ... summed
+};
+
+static int CareerRecord::* const CAREER_FIELDS[] = {
+    &CareerRecord::matches, &CareerRecord::matches_won, &CareerRecord::sets, &CareerRecord::sets_won,
+    &CareerRecord::games, &CareerRecord::games_won, &CareerRecord::service_games, &CareerRecord::service_games_held,
+    &CareerRecord::return_games, &CareerRecord::return_games_won, &CareerRecord::tiebreaks, &CareerRecord::tiebreaks_won,
+};
+static const int CAREER_FIELD_COUNT = (int)(sizeof(CAREER_FIELDS)/sizeof(CAREER_FIELDS[0]));
+
+static void add_stats(PlayerStats& into, const PlayerStats& s) {
+    for (int i=0;i<STAT_FIELD_COUNT;i++) into.*STAT_FIELDS[i] += s.*STAT_FIELDS[i];
+}
+
+static void add_career(CareerRecord& into, const CareerRecord& r) {
+    for (int i=0;i<CAREER_FIELD_COUNT;i++) into.*CAREER_FIELDS[i] += r.*CAREER_FIELDS[i];
+    add_stats(into.stats, r.stats);
+    for (int s=0;s<CAREER_MAX_SETS;s++) add_stats(into.by_set[s], r.by_set[s]);
+}
+
+// What one finished match adds to player p's records
+static CareerRecord career_delta(const MatchState& st, int p) {
+    CareerRecord r;
+    int won = (p==0 ? st.sets_won_p1 : st.sets_won_p2), lost = (p==0 ? st.sets_won_p2 : st.sets_won_p1);
+    r.matches = 1;
+    r.matches_won = won > lost;
+    r.sets = won + lost;
+    r.sets_won = won;
+    for (size_t i=0;i<st.sets.size();i++) {
+        const SetScore& s = st.sets[i];
+        int mine = (p==0 ? s.games_player1 : s.games_player2), theirs = (p==0 ? s.games_player2 : s.games_player1);
+        r.games += mine + theirs;
+        r.games_won += mine;
+        if (s.set_tiebreak_played) {
+            r.tiebreaks++;
+            if ((p==0 ? s.tb_points_p1 > s.tb_points_p2 : s.tb_points_p2 > s.tb_points_p1)) r.tiebreaks_won++;
+        }
+        if (i < (size_t)CAREER_MAX_SETS)
+            r.by_set[i] = (p==0 ? st.per_set_stats_p1[i] : st.per_set_stats_p2[i]);
+    }
+    // A game's winner is whoever won its last point
+    for (size_t i=0;i<st.log_entries.size();i++) {
+        const PointLogEntry& e = st.log_entries[i];
+        if (e.in_tiebreak) continue;
+        if (i+1 < st.log_entries.size() && st.log_entries[i+1].set_index == e.set_index
+            && st.log_entries[i+1].game_index == e.game_index && !st.log_entries[i+1].in_tiebreak) continue;
+        if (e.server_player == p) { r.service_games++; if (e.point_winner == p) r.service_games_held++; }
+        else { r.return_games++; if (e.point_winner == p) r.return_games_won++; }
+    }
+    r.stats = (p==0 ? st.match_stats_p1 : st.match_stats_p2);
+    return r;
+}
+
+class PlayerDb {
+public:
+    // A missing file is an empty database
+    bool load(const string& path, string& err) {
+        string text;
+        if (!read_whole_file(path, text)) {
+            if (errno == ENOENT) return true;
+            err = strerror(errno);
+            return false;
+        }
+        size_t pos = 0, line_no = 0;
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == string::npos) end = text.size();
+            string line = text.substr(pos, end - pos);
+            pos = end + 1;
+            line_no++;
+            if (line_no == 1) {
+                if (line != PLAYER_DB_HEADER) { err = "not a player database"; return false; }
+                continue;
+            }
+            if (line.empty()) continue;
+            if (!parse_line(line)) { err = "bad line " + to_string(line_no); return false; }
+        }
+        return true;
+    }
+
+    // Writes a new file and renames it over the old one
+    bool save(const string& path) const {
+        OutBuf o;
+        o << PLAYER_DB_HEADER << '\n';
+        for (size_t id=0;id<names_.size();id++) o << "player " << id << ' ' << names_[id] << '\n';
+        for (size_t id=0;id<career_.size();id++) { o << "career " << id; render_counts(o, career_[id]); }
+        for (const auto& kv : season_) { o << "season " << kv.first.first << ' ' << kv.first.second; render_counts(o, kv.second); }
+        for (const auto& kv : surface_) {
+            o << "surface " << kv.first.first << ' ' << SURFACE_NAMES[kv.first.second];
+            render_counts(o, kv.second);
+        }
+        string tmp = path + ".tmp";
+        if (!write_whole_file(tmp, o)) return false;
+        return rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    uint32_t intern(const string& name) {
+        auto it = ids_.find(name);
+        if (it != ids_.end()) return it->second;
+        uint32_t id = (uint32_t)names_.size();
+        ids_.emplace(name, id);
+        names_.push_back(name);
+        career_.emplace_back();
+        return id;
+    }
+
+    bool find(const string& name, uint32_t& id) const {
+        auto it = ids_.find(name);
+        if (it == ids_.end()) return false;
+        id = it->second;
+        return true;
+    }
+
+    void fold_match(const MatchState& st, int year, Surface surface) {
+        for (int p=0;p<2;p++) {
+            uint32_t id = intern(p==0 ? st.player1_name : st.player2_name);
+            CareerRecord r = career_delta(st, p);
+            add_career(career_[id], r);
+            add_career(season_[{id, year}], r);
+            add_career(surface_[{id, (int)surface}], r);
+        }
+    }
+
+    void render_player(OutBuf& o, uint32_t id) const {
+        o << "Career: " << names_[id] << "\n========\n";
+        render_summary(o, "All matches", career_[id]);
+        o << "\nBy season:\n";
+        for (auto it = season_.lower_bound({id, INT_MIN}); it != season_.end() && it->first.first == id; ++it)
+            render_summary(o, "  " + to_string(it->first.second), it->second);
+        o << "\nBy surface:\n";
+        for (auto it = surface_.lower_bound({id, INT_MIN}); it != surface_.end() && it->first.first == id; ++it)
+            render_summary(o, string("  ") + SURFACE_NAMES[it->first.second], it->second);
+        o << "\nBy set:\n";
+        for (int s=0;s<CAREER_MAX_SETS;s++) {
+            // Per-set stats carry no point totals, so this sticks to serve and pressure
+            const PlayerStats& ps = career_[id].by_set[s];
+            if (!ps.first_serves_attempted && !ps.return_points_won_vs_first && !ps.return_points_won_vs_second) continue;
+            o << "  Set " << (s+1) << ": 1st serve in " << Percent{ps.first_serves_in, ps.first_serves_attempted}
+              << ", 1st pts won " << Percent{ps.points_won_on_first_serve, ps.first_serves_in}
+              << ", 2nd pts won " << Percent{ps.points_won_on_second_serve, ps.second_serves_in}
+              << ", aces " << (ps.aces_first + ps.aces_second) << ", DF " << ps.double_faults
+              << ", break points " << ps.break_points_won << '/' << ps.break_points_total << '\n';
+        }
+        render_stats_txt(o, career_[id].stats, "Career totals");
+    }
+
+private:
+    static void render_counts(OutBuf& o, const CareerRecord& r) {
+        for (int i=0;i<CAREER_FIELD_COUNT;i++) o << ' ' << r.*CAREER_FIELDS[i];
+        for (int i=0;i<STAT_FIELD_COUNT;i++) o << ' ' << r.stats.*STAT_FIELDS[i];
+        for (int s=0;s<CAREER_MAX_SETS;s++)
+            for (int i=0;i<STAT_FIELD_COUNT;i++) o << ' ' << r.by_set[s].*STAT_FIELDS[i];
+        o << '\n';
+    }
+
+    static void render_summary(OutBuf& o, const string& label, const CareerRecord& r) {
+        o << label << ": matches " << r.matches_won << '-' << (r.matches - r.matches_won)
+          << ", sets " << r.sets_won << '-' << (r.sets - r.sets_won)
+          << ", games " << r.games_won << '-' << (r.games - r.games_won)
+          << ", held " << r.service_games_held << '/' << r.service_games << " (" << Percent{r.service_games_held, r.service_games} << ')'
+          << ", broke " << r.return_games_won << '/' << r.return_games << " (" << Percent{r.return_games_won, r.return_games} << ')'
+          << ", tiebreaks " << r.tiebreaks_won << '-' << (r.tiebreaks - r.tiebreaks_won) << '\n';
+    }
+
+    static bool parse_counts(const char*& p, CareerRecord& r) {
+        auto next = [&p](int& v) {
+            while (*p == ' ') p++;
+            auto res = from_chars(p, p + strlen(p), v);
+            if (res.ec != errc() || res.ptr == p) return false;
+            p = res.ptr;
+            return true;
+        };
+        for (int i=0;i<CAREER_FIELD_COUNT;i++) if (!next(r.*CAREER_FIELDS[i])) return false;
+        for (int i=0;i<STAT_FIELD_COUNT;i++) if (!next(r.stats.*STAT_FIELDS[i])) return false;
+        for (int s=0;s<CAREER_MAX_SETS;s++)
+            for (int i=0;i<STAT_FIELD_COUNT;i++) if (!next(r.by_set[s].*STAT_FIELDS[i])) return false;
+        return *p == '\0';
+    }
+
+    bool parse_line(const string& line) {
+        char kind[16];
+        unsigned id = 0;
+        int used = 0;
+        if (sscanf(line.c_str(), "%15s %u %n", kind, &id, &used) < 2) return false;
+        const char* rest = line.c_str() + used;
+        string k = kind;
+        if (k == "player") {
+            if (id != names_.size() || ids_.count(rest)) return false;
+            intern(rest);
+            return true;
+        }
+        if (id >= names_.size()) return false;
+        if (k == "career") return parse_counts(rest, career_[id]);
+        char key[16];
+        int key_used = 0;
+        if (sscanf(rest, "%15s %n", key, &key_used) < 1) return false;
+        const char* counts = rest + key_used;
+        if (k == "season") {
+            int year = atoi(key);
+            return year > 0 && parse_counts(counts, season_[{id, year}]);
+        }
+        if (k == "surface") {
+            for (int s=0;s<SURFACE_COUNT;s++)
+                if (strcmp(key, SURFACE_NAMES[s]) == 0) return parse_counts(counts, surface_[{id, s}]);
+        }
+        return false;
+    }
+
+    unordered_map<string, uint32_t> ids_;
+    vector<string> names_;
+    vector<CareerRecord> career_;                  // indexed by id
+    map<pair<uint32_t, int>, CareerRecord> season_;    // (id, year), sorted so a player's rows are adjacent
+    map<pair<uint32_t, int>, CareerRecord> surface_;   // (id, Surface)
+};
+
+static bool parse_surface(const string& s, Surface& out) {
+    for (int i=0;i<SURFACE_COUNT;i++) if (s == SURFACE_NAMES[i]) { out = (Surface)i; return true; }
+    return false;
+}
+
+// Holds an exclusive lock on PATH.lock, so trackers sharing one database
+// (several courts, say) take turns.
+class PlayerDbLock {
+public:
+    explicit PlayerDbLock(const string& path) {
+        fd_ = open((path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ >= 0) flock(fd_, LOCK_EX);
+    }
+    ~PlayerDbLock() { if (fd_ >= 0) close(fd_); }
+private:
+    int fd_;
+};
+
+// Folds a finished match into the database at path. Problems are reported
+// on stderr and leave the file as it was.
+static bool record_finished_match(const string& path, const MatchState& st, Surface surface) {
+    if (path.empty() || !match_is_over_now(st)) return false;
+    TraceSpan t("player db");
+    PlayerDbLock lock(path);
+    PlayerDb db;
+    string err;
+    if (!db.load(path, err)) { cerr << "Player database " << path << ": " << err << "; match not recorded\n"; return false; }
+    time_t now = time(nullptr);
+    tm local;
+    localtime_r(&now, &local);   // may run on the export pool
+    db.fold_match(st, local.tm_year + 1900, surface);
+    if (db.save(path)) return true;
+    cerr << "Cannot write player database " << path << ": " << strerror(errno) << "\n";
+    return false;
+}
+
+static int show_career(const string& path, const string& name) {
+    PlayerDb db;
+    string err;
+    {
+        PlayerDbLock lock(path);
+        if (!db.load(path, err)) { cerr << "Player database " << path << ": " << err << "\n"; return 1; }
+    }
+    uint32_t id;
+    if (!db.find(name, id)) { cerr << "No player named '" << name << "' in " << path << "\n"; return 1; }
+    OutBuf o;
+    db.render_player(o, id);
+    write_stdout(o);
+    return 0;
+}
+
+// =============== Background export ===============
+// Exports run on a small worker pool so the operator gets the menu back
+// right away. Every job renders from the same immutable snapshot of the
+// match; the main loop prints completion messages once a whole export
+// has finished (see report_finished_exports).
+
+class WorkerPool {
+public:
+    ~WorkerPool() { stop(); }
+
+    void submit(function<void()> job) {
+        {
+            lock_guard<mutex> lk(m_);
+            if (workers_.empty()) {
+                unsigned n = thread::hardware_concurrency();
+                if (n == 0) n = 2;
+                if (n > 5) n = 5;   // one per export file is plenty
+                for (unsigned i=0;i<n;i++) workers_.emplace_back([this]{ run(); });
+            }
+            jobs_.push_back(std::move(job));
+            pending_++;
+        }
+        cv_.notify_one();
+    }
+
+    // Blocks until every submitted job has run.
+    void wait_idle() {
+        unique_lock<mutex> lk(m_);
+        idle_cv_.wait(lk, [this]{ return pending_ == 0; });
+    }
+
+    void stop() {
+        {
+            lock_guard<mutex> lk(m_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : workers_) t.join();
+        workers_.clear();
+    }
+
+private:
+    void run() {
+        for (;;) {
+            function<void()> job;
+            {
+                unique_lock<mutex> lk(m_);
+                cv_.wait(lk, [this]{ return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty()) return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+            {
+                lock_guard<mutex> lk(m_);
+                if (--pending_ == 0) idle_cv_.notify_all();
+            }
+        }
+    }
+
+    vector<thread> workers_;
+    deque<function<void()>> jobs_;
+    mutex m_;
+    condition_variable cv_, idle_cv_;
+    int pending_ = 0;
+    bool stopping_ = false;
+};
+
+static WorkerPool& export_pool() {
+    static WorkerPool pool;
+    return pool;
+}
+
+// One in-flight save_match_files call. Workers fill in their slot and the
+// last one to finish queues the whole export for reporting.
+struct ExportBatch {
+    string base;
+    shared_ptr<const MatchState> snapshot;
+    atomic<int> remaining{0};
+    bool txt_ok=false, json_ok=false;
+};
+
+static mutex finished_exports_mutex;
+static vector<shared_ptr<ExportBatch>> finished_exports;
+
+static void export_job_done(const shared_ptr<ExportBatch>& batch) {
+    if (batch->remaining.fetch_sub(1) != 1) return;
+    batch->snapshot.reset();
+    lock_guard<mutex> lk(finished_exports_mutex);
+    finished_exports.push_back(batch);
+}
+
+// `span` names the job in the trace and must be a string literal.
+static void submit_export_file(const shared_ptr<ExportBatch>& batch, string path, const char* span,
+                               void (*render)(OutBuf&, const MatchState&), bool* ok) {
+    export_pool().submit([batch, path, span, render, ok]{
+        AllocSiteScope site(SITE_EXPORT);
+        TraceSpan job(span);
+        OutBuf& out = scratch_buffer();
+        {
+            TraceSpan t("render file");
+            render(out, *batch->snapshot);
+        }
+        bool written;
+        {
+            TraceSpan t("write file");
+            written = write_whole_file(path, out);
+        }
+        if (ok) *ok = written;
+        export_job_done(batch);
+    });
+}
+
+// Prints the messages for exports that completed since the last call.
+static void report_finished_exports() {
+    vector<shared_ptr<ExportBatch>> done;
+    {
+        lock_guard<mutex> lk(finished_exports_mutex);
+        done.swap(finished_exports);
+    }
+    for (const auto& b : done) {
+        if (b->txt_ok) cout << "Saved text summary: " << b->base << ".txt\n";
+        if (b->json_ok) cout << "Saved JSON data: " << b->base << ".json\n";
+        cout << "Saved CSVs: " << b->base << "_match_totals.csv, _per_set_stats.csv, _points.csv\n";
+    }
+}
+
+// Waits for outstanding exports before the program exits.
+static void finish_background_exports() {
+    TraceSpan t("wait for exports");
+    export_pool().wait_idle();
+    report_finished_exports();
+}
+
+static void save_match_files(const MatchState& st) {
+    TraceSpan t("save_match_files");
+    string base = st.player1_name + "_vs_" + st.player2_name + "_" + now_date_time_string();
+    for (char& c : base) if (c==' ') c='_';
+
+    auto batch = make_shared<ExportBatch>();
+    batch->base = base;
+    {
+        TraceSpan snap("snapshot");
+        batch->snapshot = make_shared<const MatchState>(st);
+    }
+    batch->remaining = 5;
+
+    submit_export_file(batch, base + ".txt", "export txt", render_match_txt, &batch->txt_ok);
+    submit_export_file(batch, base + ".json", "export json", render_match_json, &batch->json_ok);
+    submit_export_file(batch, base + "_match_totals.csv", "export totals csv", render_totals_csv, nullptr);
+    submit_export_file(batch, base + "_per_set_stats.csv", "export per-set csv", render_per_set_csv, nullptr);
+    submit_export_file(batch, base + "_points.csv", "export points csv", render_points_csv, nullptr);
+}
+
+// =============== Bulk export ===============
+// Regenerating a whole archive means thousands of small files. Rather than
+// one blocking open/write/close per file, files are pushed through an
+// io_uring: opens, writes and closes for up to BULK_QUEUE_DEPTH files are in
+// flight at once. Where io_uring is unavailable (old kernel, seccomp, non
+// Linux) the same batch is written with open/pwrite/close.
+
+struct BulkFile {
+    string path;
+    string data;
+    bool ok = false;
+};
+
+static const unsigned BULK_QUEUE_DEPTH = 4096;
+
+static bool write_file_sync(BulkFile& f) {
+    int fd = open(f.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    size_t off = 0;
+    while (off < f.data.size()) {
+        ssize_t n = pwrite(fd, f.data.data() + off, f.data.size() - off, (off_t)off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) { close(fd); return false; }
+        off += (size_t)n;
+    }
+    return close(fd) == 0;
+}
+
+// How many files may be open at once: the queue depth, capped by the fd
+// limit (raised to the hard limit first) with some headroom.
+static unsigned bulk_open_budget() {
+    rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return 256;
+    if (rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > BULK_QUEUE_DEPTH + 64) return BULK_QUEUE_DEPTH;
+    return rl.rlim_cur > 128 ? (unsigned)rl.rlim_cur - 64 : 64;
+}
+
+#ifdef HAVE_IO_URING
+
+// Minimal raw io_uring (no liburing dependency): one SQ/CQ pair, submit and
+// reap only. Sized so every in-flight file has at most one SQE queued.
+class Uring {
+public:
+    ~Uring() { destroy(); }
+
+    bool init(unsigned entries) {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd_ < 0) return false;
+
+        sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) sq_len_ = cq_len_ = (sq_len_ > cq_len_ ? sq_len_ : cq_len_);
+        sq_ptr_ = mmap(nullptr, sq_len_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) { sq_ptr_ = nullptr; destroy(); return false; }
+        if (p.features & IORING_FEAT_SINGLE_MMAP) cq_ptr_ = sq_ptr_;
+        else {
+            cq_ptr_ = mmap(nullptr, cq_len_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+            if (cq_ptr_ == MAP_FAILED) { cq_ptr_ = nullptr; destroy(); return false; }
+        }
+        sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_len_, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) { destroy(); return false; }
+        sqes_ = (io_uring_sqe*)sqes;
+
+        char* sq = (char*)sq_ptr_;
+        char* cq = (char*)cq_ptr_;
+        sq_head_ = (unsigned*)(sq + p.sq_off.head);
+        sq_tail_ = (unsigned*)(sq + p.sq_off.tail);
+        sq_mask_ = *(unsigned*)(sq + p.sq_off.ring_mask);
+        sq_array_ = (unsigned*)(sq + p.sq_off.array);
+        cq_head_ = (unsigned*)(cq + p.cq_off.head);
+        cq_tail_ = (unsigned*)(cq + p.cq_off.tail);
+        cq_mask_ = *(unsigned*)(cq + p.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        sq_entries_ = p.sq_entries;
+        return true;
+    }
+
+    io_uring_sqe* next_sqe() {
+        unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (local_tail_ - head >= sq_entries_) return nullptr;
+        unsigned idx = local_tail_ & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array_[idx] = idx;
+        local_tail_++;
+        return sqe;
+    }
+
+    // next_sqe, first handing the queued SQEs to the kernel if the SQ is
+    // full. Null only if the kernel did not take any of them.
+    io_uring_sqe* get_sqe() {
+        io_uring_sqe* sqe = next_sqe();
+        if (!sqe && submit(0)) sqe = next_sqe();
+        return sqe;
+    }
+
+    // Publishes queued SQEs and waits until at least one completion exists.
+    bool submit_and_wait() { return submit(1); }
+
+private:
+    bool submit(unsigned min_complete) {
+        unsigned to_submit = local_tail_ - *sq_tail_;
+        __atomic_store_n(sq_tail_, local_tail_, __ATOMIC_RELEASE);
+        unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+        for (;;) {
+            int r = (int)syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags, nullptr, 0);
+            if (r >= 0) return true;
+            if (errno == EINTR) { to_submit = 0; continue; }
+            return false;
+        }
+    }
+
+public:
+
+    template <class F>
+    void reap(F&& on_cqe) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const io_uring_cqe& c = cqes_[head & cq_mask_];
+            on_cqe(c.user_data, c.res);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    void destroy() {
+        if (sqes_) munmap(sqes_, sqes_len_);
+        if (cq_ptr_ && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_len_);
+        if (sq_ptr_) munmap(sq_ptr_, sq_len_);
+        if (fd_ >= 0) close(fd_);
+        sqes_ = nullptr; sq_ptr_ = cq_ptr_ = nullptr; fd_ = -1;
+    }
+
+    int fd_ = -1;
+    void* sq_ptr_ = nullptr;
+    void* cq_ptr_ = nullptr;
+    size_t sq_len_ = 0, cq_len_ = 0, sqes_len_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned *sq_head_ = nullptr, *sq_tail_ = nullptr, *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr, *cq_tail_ = nullptr;
+    unsigned sq_mask_ = 0, cq_mask_ = 0, sq_entries_ = 0;
+    unsigned local_tail_ = 0;
+};
+
+enum BulkOp { BULK_OPEN=0, BULK_WRITE=1, BULK_CLOSE=2 };
+
+// Returns false only if the ring itself failed; per-file errors land in ok.
+static bool write_files_uring(vector<BulkFile>& files, unsigned window) {
+    Uring ring;
+    if (!ring.init(window)) return false;
+
+    struct Slot { int fd = -1; size_t off = 0; bool failed = false; };
+    vector<Slot> slots(files.size());
+    size_t next = 0, done = 0;
+    unsigned in_flight = 0;
+
+    auto tag = [](size_t i, BulkOp op) { return (uint64_t)i << 2 | (uint64_t)op; };
+    // No SQE to be had: the rest of file i is written and closed here.
+    auto finish_sync = [&](size_t i) {
+        Slot& sl = slots[i];
+        while (!sl.failed && sl.off < files[i].data.size()) {
+            ssize_t n = pwrite(sl.fd, files[i].data.data() + sl.off, files[i].data.size() - sl.off, (off_t)sl.off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) sl.failed = true;
+            else sl.off += (size_t)n;
+        }
+        files[i].ok = (close(sl.fd) == 0) && !sl.failed;
+        in_flight--; done++;
+    };
+    auto queue_write = [&](size_t i) {
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (!sqe) { finish_sync(i); return; }
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = slots[i].fd;
+        sqe->addr = (uint64_t)(uintptr_t)(files[i].data.data() + slots[i].off);
+        sqe->len = (unsigned)(files[i].data.size() - slots[i].off);
+        sqe->off = slots[i].off;
+        sqe->user_data = tag(i, BULK_WRITE);
+    };
+    auto queue_close = [&](size_t i) {
+        io_uring_sqe* sqe = ring.get_sqe();
+        if (!sqe) { finish_sync(i); return; }
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = slots[i].fd;
+        sqe->user_data = tag(i, BULK_CLOSE);
+    };
+
+    while (done < files.size()) {
+        while (next < files.size() && in_flight < window) {
+            io_uring_sqe* sqe = ring.next_sqe();
+            if (!sqe) break;
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t)files[next].path.c_str();
+            sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+            sqe->len = 0644;
+            sqe->user_data = tag(next, BULK_OPEN);
+            next++;
+            in_flight++;
+        }
+        if (!ring.submit_and_wait()) return false;
+        ring.reap([&](uint64_t ud, int res) {
+            size_t i = (size_t)(ud >> 2);
+            Slot& sl = slots[i];
+            switch ((BulkOp)(ud & 3)) {
+            case BULK_OPEN:
+                if (res == -EINVAL || res == -EOPNOTSUPP) {
+                    // Kernel without IORING_OP_OPENAT: do this file directly.
+                    files[i].ok = write_file_sync(files[i]);
+                    in_flight--; done++;
+                } else if (res < 0) {
+                    files[i].ok = false;
+                    in_flight--; done++;
+                } else {
+                    sl.fd = res;
+                    if (files[i].data.empty()) queue_close(i); else queue_write(i);
+                }
+                break;
+            case BULK_WRITE:
+                if (res <= 0) { sl.failed = true; queue_close(i); break; }
+                sl.off += (size_t)res;
+                if (sl.off < files[i].data.size()) queue_write(i); else queue_close(i);
+                break;
+            case BULK_CLOSE:
+                files[i].ok = !sl.failed && res == 0;
+                in_flight--; done++;
+                break;
+            }
+        });
+    }
+    return true;
+}
+
+#endif // HAVE_IO_URING
+
+static void write_files_bulk(vector<BulkFile>& files) {
+    TraceSpan t("bulk write");
+    if (files.empty()) return;
+#ifdef HAVE_IO_URING
+    unsigned window = bulk_open_budget();
+    if (window > files.size()) window = (unsigned)files.size();
+    if (write_files_uring(files, window)) return;
+#endif
+    for (auto& f : files) f.ok = write_file_sync(f);
+}
+
+struct ExportFormat {
+    const char* suffix;
+    void (*render)(OutBuf&, const MatchState&);
+};
+
+static const ExportFormat EXPORT_FORMATS[] = {
+    {".txt", render_match_txt},
+    {".json", render_match_json},
+    {"_match_totals.csv", render_totals_csv},
+    {"_per_set_stats.csv", render_per_set_csv},
+    {"_points.csv", render_points_csv},
+};
+static const int EXPORT_FORMAT_COUNT = (int)(sizeof(EXPORT_FORMATS)/sizeof(EXPORT_FORMATS[0]));
+
+// Creates dir if needed; false (reported on stderr) if it cannot be
+// created or is not a directory.
+static bool make_output_dir(const string& dir) {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        cerr << "Cannot create " << dir << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    struct stat sb;
+    if (stat(dir.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode)) {
+        cerr << "Not a directory: " << dir << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Output stem for each input: the file name without ".json", with "-2",
+// "-3", ... added where two inputs (from different directories) would
+// otherwise write the same files.
+static vector<string> reexport_stems(const vector<string>& inputs) {
+    vector<string> stems;
+    stems.reserve(inputs.size());
+    unordered_map<string, int> used;
+    for (const string& in : inputs) {
+        string stem = in.substr(in.find_last_of('/') + 1);
+        if (stem.size() > 5 && stem.compare(stem.size()-5, 5, ".json") == 0) stem.resize(stem.size()-5);
+        string out = stem;
+        for (int k = 2; used.count(out); k++) out = stem + "-" + to_string(k);
+        used[out] = 1;
+        if (out != stem) cerr << "Exporting " << in << " as " << out << " (name already taken)\n";
+        stems.push_back(out);
+    }
+    return stems;
+}
+
+// Re-exports every .json match in inputs into out_dir. Matches are loaded and
+// rendered on the worker pool a chunk at a time, then each chunk's files go
+// out as one bulk write. Returns the number of files that failed, or -1 if
+// out_dir cannot be created.
+static int reexport_archive(const vector<string>& inputs, const string& out_dir) {
+    if (!make_output_dir(out_dir)) return -1;
+    const vector<string> stems = reexport_stems(inputs);
+    const size_t chunk = BULK_QUEUE_DEPTH / EXPORT_FORMAT_COUNT;
+    int failed = 0;
+    size_t written = 0;
+    auto t0 = chrono::steady_clock::now();
+
+    for (size_t start = 0; start < inputs.size(); start += chunk) {
+        size_t n = min(chunk, inputs.size() - start);
+        vector<BulkFile> files(n * EXPORT_FORMAT_COUNT);
+        vector<char> loaded(n, 0);
+        for (size_t k = 0; k < n; k++) {
+            export_pool().submit([&, k]{
+                const string& in = inputs[start + k];
+                AllocSiteScope site(SITE_EXPORT);
+                TraceSpan t("reexport match");
+                MatchState st;
+                if (!load_match_json(in, st)) return;
+                const string& stem = stems[start + k];
+                for (int f = 0; f < EXPORT_FORMAT_COUNT; f++) {
+                    OutBuf out;
+                    EXPORT_FORMATS[f].render(out, st);
+                    BulkFile& bf = files[k * EXPORT_FORMAT_COUNT + f];
+                    bf.path = out_dir + "/" + stem + EXPORT_FORMATS[f].suffix;
+                    bf.data = std::move(out.data);
+                }
+                loaded[k] = 1;
+            });
+        }
+        export_pool().wait_idle();
+
+        vector<BulkFile> ready;
+        ready.reserve(files.size());
+        for (size_t k = 0; k < n; k++) {
+            if (!loaded[k]) { cerr << "Skipping unreadable match: " << inputs[start + k] << "\n"; failed++; continue; }
+            for (int f = 0; f < EXPORT_FORMAT_COUNT; f++) ready.push_back(std::move(files[k * EXPORT_FORMAT_COUNT + f]));
+        }
+        write_files_bulk(ready);
+        for (const auto& f : ready) {
+            if (f.ok) written++;
+            else { cerr << "Could not write " << f.path << "\n"; failed++; }
+        }
+    }
+
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    cout << "Re-exported " << written << " files from " << inputs.size() << " matches in "
+         << secs << " s\n";
+    return failed;
+}
+
+// =============== Live point stream ===============
+// With --live / --live-fd every completed point is appended as one NDJSON
+// line (the log entry plus the scoreline after it). Undos append an "undo"
+// line with the restored scoreline. The scoring loop only copies each change
+// into an immutable LiveUpdate and pushes it onto an SpscRing; a publisher
+// thread renders and writes the lines, so neither the formatting nor a slow
+// reader can hold up point entry. If a reader falls LIVE_RING_SIZE updates
+// behind, newer ones are dropped (and counted) until it catches up.
+
+struct LiveUpdate {
+    bool undo = false;
+    size_t points = 0;        // log length after the change
+    PointLogEntry entry;      // the point just played (point updates only)
+    ScoreCore score;
+    SetScore current_set;
+};
+
+static const size_t LIVE_RING_SIZE = 1024;
+static const int LIVE_IDLE_MS = 20;   // publisher re-checks the ring at least this often
+
+struct LiveStream {
+    int fd = -1;
+    bool owns_fd = false;
+    int saved_flags = -1;     // --live-fd: the caller's flags, put back at close
+    // Main thread only
+    size_t published_points = 0;
+    uint64_t dropped = 0;
+    // Shared with the publisher
+    unique_ptr<SpscRing<LiveUpdate, LIVE_RING_SIZE>> ring;
+    thread publisher;
+    mutex m;
+    condition_variable cv;
+    bool stopping = false;
+    // Publisher only
+    string pending;           // bytes not yet accepted by the fd
+    bool reader_gone = false; // the fd hung up; later updates are discarded
+};
+
+static LiveStream live;
+
+// A reader that closes a pipe or socket must not take the tracker down with
+// SIGPIPE; the publisher sees EPIPE instead and stops writing.
+static void live_ignore_sigpipe() {
+    signal(SIGPIPE, SIG_IGN);
+}
+
+static bool live_stream_open(const string& target) {
+    live_ignore_sigpipe();
+    if (target == "-") {
+        // Leave stdout's blocking mode alone (cout shares it). The publisher
+        // writes whole lines, at most PIPE_BUF bytes at a time, so on a pipe
+        // no update line is split by console output; console text can still
+        // land between update lines.
+        live.fd = STDOUT_FILENO;
+        return true;
+    }
+    live.fd = open(target.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK, 0644);
+    live.owns_fd = (live.fd >= 0);
+    return live.fd >= 0;
+}
+
+// fd must already be open and not one of stdin/stdout/stderr (stdout is
+// --live -). Its file status flags are restored by live_stream_close.
+static bool live_stream_attach_fd(int fd) {
+    if (fd <= STDERR_FILENO) { errno = EBADF; return false; }
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return false;
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) return false;
+    live_ignore_sigpipe();
+    live.fd = fd;
+    live.saved_flags = flags;
+    return true;
+}
+
+// How much of pending to hand to one write(). On stdout that is the whole
+// lines that fit in PIPE_BUF (a longer line goes alone), or the rest of a
+// line a short write cut off, so each write is atomic on a pipe.
+static size_t live_write_size() {
+    const string& p = live.pending;
+    if (live.fd != STDOUT_FILENO || p.size() <= PIPE_BUF) return p.size();
+    size_t nl = p.rfind('\n', PIPE_BUF - 1);
+    if (nl == string::npos) nl = p.find('\n');
+    return nl == string::npos ? p.size() : nl + 1;
+}
+
+// Publisher thread: writes out everything pending, waiting for the reader
+// as long as it takes. A reader that hangs up (EPIPE, POLLERR/POLLHUP)
+// discards the rest and everything after it.
+static void live_stream_flush() {
+    if (live.reader_gone) { live.pending.clear(); return; }
+    while (!live.pending.empty()) {
+        size_t chunk = live_write_size();
+        ssize_t n = write(live.fd, live.pending.data(), chunk);
+        if (n >= 0) { live.pending.erase(0, (size_t)n); continue; }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) break;
+        pollfd pfd{live.fd, POLLOUT, 0};
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) break;
+        if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) break;
+    }
+    if (!live.pending.empty()) {
+        live.pending.clear();
+        live.reader_gone = true;
+    }
+}
+
+static void live_render_scoreline(OutBuf& b, const ScoreCore& sc, const SetScore& cur) {
+    string pts1, pts2;
+    point_strings(sc, pts1, pts2);
+    b << "\"score\":{\"sets\":[" << sc.sets_won_p1 << ',' << sc.sets_won_p2
+      << "],\"games\":[" << cur.games_player1 << ',' << cur.games_player2
+      << "],\"points\":[\"" << pts1 << "\",\"" << pts2
+      << "\"],\"tb\":" << ((sc.in_set_tiebreak || sc.in_match_tiebreak10) ? "true" : "false")
+      << ",\"server\":" << (sc.current_server==0 ? "\"P1\"" : "\"P2\"") << '}';
+}
+
+static void live_render_update(OutBuf& b, const LiveUpdate& u) {
+    if (u.undo) {
+        b << "{\"type\":\"undo\",\"points\":" << u.points << ',';
+    } else {
+        b << "{\"type\":\"point\",\"point\":";
+        render_point_json(b, u.entry, u.points);
+        b << ',';
+    }
+    live_render_scoreline(b, u.score, u.current_set);
+    b << "}\n";
+}
+
+static void live_publish_loop() {
+    OutBuf b;
+    LiveUpdate u;
+    for (;;) {
+        b.data.clear();
+        while (live.ring->pop(u)) live_render_update(b, u);
+        if (!b.data.empty()) {
+            TraceSpan t("publish live");
+            live.pending.append(b.data);
+            live_stream_flush();
+            continue;
+        }
+        unique_lock<mutex> lk(live.m);
+        if (live.stopping && live.ring->empty()) return;
+        live.cv.wait_for(lk, chrono::milliseconds(LIVE_IDLE_MS));
+    }
+}
+
+static void live_push(LiveUpdate u) {
+    if (!live.ring->push(std::move(u))) live.dropped++;
+}
+
+// Queues updates for whatever changed in the log since the last call.
+static void live_stream_sync(const MatchState& st) {
+    if (live.fd < 0) return;
+    if (!live.ring) {
+        live.ring.reset(new SpscRing<LiveUpdate, LIVE_RING_SIZE>);
+        live.publisher = thread(live_publish_loop);
+    }
+    size_t n = st.log_entries.size();
+    LiveUpdate u;
+    u.score = st;
+    u.current_set = st.sets[st.current_set_index];
+    if (n < live.published_points) {
+        u.undo = true;
+        u.points = n;
+        live_push(u);
+        u.undo = false;
+    }
+    for (size_t i = live.published_points; i < n; i++) {
+        u.points = i + 1;
+        u.entry = st.log_entries[i];
+        live_push(u);
+    }
+    live.published_points = n;
+    live.cv.notify_one();
+}
+
+// Waits for the publisher to write out everything queued.
+static void live_stream_close() {
+    if (live.fd < 0) return;
+    if (live.publisher.joinable()) {
+        {
+            lock_guard<mutex> lk(live.m);
+            live.stopping = true;
+        }
+        live.cv.notify_one();
+        live.publisher.join();
+    }
+    if (live.owns_fd) close(live.fd);
+    else if (live.saved_flags >= 0) fcntl(live.fd, F_SETFL, live.saved_flags);
+    live.fd = -1;
+    if (live.dropped) cerr << "Live stream: dropped " << live.dropped << " updates (reader too slow)\n";
+}
+
+// =============== Shared-memory scoreboard ===============
+// --shm NAME publishes the current score into the POSIX shared-memory
+// segment NAME (e.g. /court1) after every point and undo, for displays on
+// the same host. The payload is a fixed layout guarded by a seqlock: the
+// writer makes seq odd, copies the payload in, and makes it even again.
+// A reader copies the payload out between two loads of seq and retries if
+// they differ or are odd, so reading costs no syscalls and never makes the
+// writer wait. --watch NAME is such a reader. The writer holds an flock on
+// the segment for as long as it runs, so a board left by a tracker that
+// died can be told from a live one.
+
+static const int SHM_NAME_LEN = 48;
+static const int SHM_MAX_SETS = 5;
+static const uint32_t SHM_MAGIC = 0x32425354;   // "TSB2": TSB1 writers did not lock
+static const int SHM_READ_SPINS = 64;           // tries before sleeping between them
+static const int SHM_READ_SLEEPS = 1000;        // 1 ms each; then the writer is stuck mid-update
+
+struct ShmScore {
+    char player[2][SHM_NAME_LEN];   // NUL-terminated, cut to fit
+    int32_t set_count;
+    int32_t games[SHM_MAX_SETS][2];
+    int32_t set_tb_points[SHM_MAX_SETS][2];   // -1 when the set had no tiebreak
+    int32_t sets_won[2];
+    char points[2][4];              // "0".."40", "Ad", "" or tiebreak points
+    int32_t server;                 // 0 = player 1
+    int32_t tiebreak;               // 0 none, 1 set tiebreak, 2 match tiebreak
+    int32_t match_over;
+    int32_t points_played;
+    int32_t closed;                 // the writer has exited
+    uint64_t updates;               // bumped on every publish
+};
+
+struct ShmScoreboard {
+    uint32_t magic;
+    uint32_t size;                  // sizeof(ShmScoreboard), as a layout check
+    atomic<uint32_t> seq;           // odd while the writer is mid-update
+    ShmScore score;
+};
+static_assert(atomic<uint32_t>::is_always_lock_free, "seq must be usable across processes");
+
+static void fill_shm_score(ShmScore& s, const MatchState& st) {
+    memset(&s, 0, sizeof(s));
+    for (int p = 0; p < 2; p++) {
+        const string& name = (p == 0 ? st.player1_name : st.player2_name);
+        memcpy(s.player[p], name.data(), min(name.size(), (size_t)SHM_NAME_LEN - 1));
+    }
+    s.set_count = (int32_t)min(st.sets.size(), (size_t)SHM_MAX_SETS);
+    for (int i = 0; i < s.set_count; i++) {
+        const SetScore& ss = st.sets[i];
+        s.games[i][0] = ss.games_player1;
+        s.games[i][1] = ss.games_player2;
+        s.set_tb_points[i][0] = ss.set_tiebreak_played ? ss.tb_points_p1 : -1;
+        s.set_tb_points[i][1] = ss.set_tiebreak_played ? ss.tb_points_p2 : -1;
+    }
+    s.sets_won[0] = st.sets_won_p1;
+    s.sets_won[1] = st.sets_won_p2;
+    string pts1, pts2;
+    point_strings(st, pts1, pts2);
+    memcpy(s.points[0], pts1.data(), min(pts1.size(), (size_t)3));
+    memcpy(s.points[1], pts2.data(), min(pts2.size(), (size_t)3));
+    s.server = st.current_server;
+    s.tiebreak = st.in_set_tiebreak ? 1 : st.in_match_tiebreak10 ? 2 : 0;
+    s.match_over = match_is_over_now(st);
+    s.points_played = (int32_t)st.log_entries.size();
+}
+
+// Removes a board left by a tracker that died (a clean exit removes its
+// own). Only a full board from this version whose lock nobody holds counts;
+// anything else may belong to a live tracker and stays. True if the name
+// is free afterwards.
+static bool unlink_stale_board(const string& name) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) return errno == ENOENT;
+    bool stale = false;
+    struct stat sb, now;
+    if (flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &sb) == 0 && sb.st_size == (off_t)sizeof(ShmScoreboard)) {
+        void* p = mmap(nullptr, sizeof(ShmScoreboard), PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            stale = static_cast<const ShmScoreboard*>(p)->magic == SHM_MAGIC;
+            munmap(p, sizeof(ShmScoreboard));
+        }
+        // Still the segment under that name, not one another tracker just made
+        int cur = stale ? shm_open(name.c_str(), O_RDONLY, 0) : -1;
+        stale = cur >= 0 && fstat(cur, &now) == 0 && now.st_dev == sb.st_dev && now.st_ino == sb.st_ino;
+        if (cur >= 0) ::close(cur);
+        if (stale) shm_unlink(name.c_str());   // under our lock, so nobody else can
+    }
+    ::close(fd);
+    return stale;
+}
+
+class ShmScoreboardWriter {
+public:
+    ~ShmScoreboardWriter() { close(); }
+
+    // Fails with EEXIST if NAME is taken by a board that is not provably stale.
+    bool open(const string& name) {
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0 && errno == EEXIST) {
+            if (unlink_stale_board(name)) fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+            else errno = EEXIST;
+        }
+        if (fd < 0) return false;
+        // Locked before it has a size, so nobody can take it for a stale board
+        void* p = MAP_FAILED;
+        if (flock(fd, LOCK_EX) == 0 && ftruncate(fd, sizeof(ShmScoreboard)) == 0)
+            p = mmap(nullptr, sizeof(ShmScoreboard), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            int err = errno;   // for the caller's message, past unlink/close
+            shm_unlink(name.c_str());
+            ::close(fd);
+            errno = err;
+            return false;
+        }
+        fd_ = fd;
+        name_ = name;
+        board_ = static_cast<ShmScoreboard*>(p);
+        board_->seq.store(0, memory_order_relaxed);
+        board_->size = sizeof(ShmScoreboard);
+        atomic_thread_fence(memory_order_release);
+        board_->magic = SHM_MAGIC;
+        return true;
+    }
+
+    bool is_open() const { return board_ != nullptr; }
+
+    void publish(const MatchState& st) {
+        if (!board_) return;
+        fill_shm_score(next_, st);
+        next_.updates = ++updates_;
+        write();
+    }
+
+    // Marks the board closed for readers and removes the name.
+    void close() {
+        if (!board_) return;
+        next_.closed = 1;
+        next_.updates = ++updates_;
+        write();
+        munmap(board_, sizeof(ShmScoreboard));
+        shm_unlink(name_.c_str());
+        ::close(fd_);   // drops the lock, after the name is gone
+        fd_ = -1;
+        board_ = nullptr;
+    }
+
+private:
+    void write() {
+        uint32_t s = board_->seq.load(memory_order_relaxed);
+        board_->seq.store(s + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        memcpy(&board_->score, &next_, sizeof(ShmScore));
+        board_->seq.store(s + 2, memory_order_release);
+    }
+
+    string name_;
+    int fd_ = -1;   // held open for its flock
+    ShmScoreboard* board_ = nullptr;
+    ShmScore next_{};
+    uint64_t updates_ = 0;
+};
+
+static ShmScoreboardWriter shm_board;
+
+// One consistent copy of the board. Spins briefly while the writer is
+// mid-update, then sleeps between tries; false if it never finishes (the
+// writer died inside write()).
+static bool read_shm_score(const ShmScoreboard* board, ShmScore& out) {
+    for (int i = 0; i < SHM_READ_SPINS + SHM_READ_SLEEPS; i++) {
+        if (i >= SHM_READ_SPINS) this_thread::sleep_for(chrono::milliseconds(1));
+        uint32_t s1 = board->seq.load(memory_order_acquire);
+        if (s1 & 1) continue;
+        memcpy(&out, &board->score, sizeof(ShmScore));
+        atomic_thread_fence(memory_order_acquire);
+        if (board->seq.load(memory_order_relaxed) == s1) return true;
+    }
+    return false;
+}
+
+// True once nobody holds the writer's lock on fd: its tracker exited
+// without marking the board closed.
+static bool shm_writer_gone(int fd) {
+    if (flock(fd, LOCK_SH | LOCK_NB) != 0) return false;
+    flock(fd, LOCK_UN);
+    return true;
+}
+
+// --watch NAME: prints a line whenever the published score changes, until
+// the writer exits. A board whose writer died is reported as stale (exit 1).
+static int watch_scoreboard(const string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) { cerr << "No scoreboard at " << name << "\n"; return 1; }
+    struct stat sb;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &sb) == 0 && sb.st_size >= (off_t)sizeof(ShmScoreboard))
+        p = mmap(nullptr, sizeof(ShmScoreboard), PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) { cerr << "Cannot map " << name << "\n"; close(fd); return 1; }
+    const ShmScoreboard* board = static_cast<const ShmScoreboard*>(p);
+    if (board->magic != SHM_MAGIC || board->size != sizeof(ShmScoreboard)) {
+        cerr << name << " is not a scoreboard from this version\n";
+        munmap(p, sizeof(ShmScoreboard));
+        close(fd);
+        return 1;
+    }
+    ShmScore s;
+    uint64_t shown = 0;
+    int rc = 0;
+    for (;;) {
+        if (!read_shm_score(board, s)) {
+            cerr << "Scoreboard " << name << " is stale: its writer stopped mid-update\n";
+            rc = 1;
+            break;
+        }
+        // The closing update repeats the last score; skip it if that was shown
+        if (s.updates != shown && !(s.closed && s.updates == shown + 1)) {
+            OutBuf& b = scratch_buffer();
+            b << s.player[0] << " vs " << s.player[1] << "  sets " << s.sets_won[0] << '-' << s.sets_won[1] << " ";
+            for (int i = 0; i < s.set_count; i++) {
+                b << ' ' << s.games[i][0] << '-' << s.games[i][1];
+                if (s.set_tb_points[i][0] >= 0) b << '(' << s.set_tb_points[i][0] << '-' << s.set_tb_points[i][1] << ')';
+            }
+            b << "  " << (s.tiebreak ? "tb " : "") << (s.points[0][0] ? s.points[0] : "-") << ':'
+              << (s.points[1][0] ? s.points[1] : "-") << "  serving " << s.player[s.server ? 1 : 0];
+            if (s.match_over) b << "  (final)";
+            b << '\n';
+            write_stdout(b);
+            cout.flush();
+        }
+        shown = s.updates;
+        if (s.closed) break;
+        if (shm_writer_gone(fd)) {
+            cerr << "Scoreboard " << name << " is stale: its tracker exited without closing it\n";
+            rc = 1;
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+    munmap(p, sizeof(ShmScoreboard));
+    close(fd);
+    return rc;
+}
+
+// =============== Sockets ===============
+// What the court server, the score feed and the HTTP scoreboard share: Unix
+// socket setup, and a table of non-blocking connections on an epoll set.
+#ifdef HAVE_EPOLL
+
+// false (errno ENAMETOOLONG) if path does not fit in a sockaddr_un.
+static bool unix_address(const string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) { errno = ENAMETOOLONG; return false; }
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// A non-blocking Unix socket listening at path, replacing any socket file
+// left there; -1 with errno set on failure.
+static int unix_listen(const string& path, int backlog) {
+    sockaddr_un addr;
+    if (!unix_address(path, addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path.c_str());
+    if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0) {
+        int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    return fd;
+}
+
+static void epoll_watch(int ep, int fd, uint32_t events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// One sendmsg of iov; the bytes written (0 when the socket is full), or -1
+// once the peer is gone. MSG_NOSIGNAL keeps a vanished peer from raising
+// SIGPIPE.
+static ssize_t send_some(int fd, iovec* iov, size_t n) {
+    msghdr mh{};
+    mh.msg_iov = iov;
+    mh.msg_iovlen = n;
+    for (;;) {
+        ssize_t w = sendmsg(fd, &mh, MSG_NOSIGNAL);
+        if (w >= 0) return w;
+        if (errno == EINTR) continue;
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+}
+
+// Connections (structs with an fd member) on one epoll set, indexed by fd.
+// Each is watched for input, and for output only while want_output says it
+// has something backed up.
+template <class Conn>
+class ConnTable {
+public:
+    explicit ConnTable(int ep) : ep_(ep) {}
+    ~ConnTable() { drop_all(); }
+
+    ConnTable(const ConnTable&) = delete;
+    ConnTable& operator=(const ConnTable&) = delete;
+
+    // Accepts everything waiting on listen_fd; on_accept(conn) runs for each
+    // new connection before it is watched.
+    template <class F> void accept_all(int listen_fd, F on_accept) {
+        int fd;
+        while ((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            if ((size_t)fd >= conns_.size()) { conns_.resize(fd + 1); want_out_.resize(fd + 1); }
+            conns_[fd].reset(new Conn);
+            conns_[fd]->fd = fd;
+            want_out_[fd] = false;
+            on_accept(*conns_[fd]);
+            epoll_watch(ep_, fd, EPOLLIN);
+        }
+    }
+
+    Conn* find(int fd) const { return (fd >= 0 && (size_t)fd < conns_.size()) ? conns_[fd].get() : nullptr; }
+
+    void want_output(const Conn& c, bool want) {
+        if (want_out_[c.fd] == want) return;
+        epoll_event ev{};
+        ev.events = want ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.fd = c.fd;
+        epoll_ctl(ep_, EPOLL_CTL_MOD, c.fd, &ev);
+        want_out_[c.fd] = want;
+    }
+
+    void drop(int fd) {
+        epoll_ctl(ep_, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        conns_[fd].reset();
+    }
+
+    void drop_all() { for (size_t fd = 0; fd < conns_.size(); fd++) if (conns_[fd]) drop((int)fd); }
+
+    // f(conn) for every connection; f may drop the one it is given.
+    template <class F> void for_each(F f) {
+        for (size_t fd = 0; fd < conns_.size(); fd++) if (conns_[fd]) f(*conns_[fd]);
+    }
+
+private:
+    int ep_;
+    vector<unique_ptr<Conn>> conns_;
+    vector<char> want_out_;    // registered for EPOLLOUT
+};
+
+#endif // HAVE_EPOLL
+
+// =============== Score feed ===============
+// --feed PATH publishes every change of score as a fixed 24-byte binary
+// FeedMessage to any number of subscribers on the Unix socket PATH. A new
+// subscriber first gets the current score (FEED_SCORE). The scoring loop
+// only pushes messages onto an SpscRing and pokes an eventfd; the feed
+// thread does the fanout, one gather write per subscriber for everything
+// queued. Each subscriber has a bounded queue. Every message carries the
+// whole scoreline, so when a slow subscriber's queue is full its oldest
+// unsent message is dropped. It only misses intermediate steps, and seq
+// shows the gap. --subscribe PATH prints the feed.
+#ifdef HAVE_EPOLL
+
+enum FeedType : uint8_t { FEED_SCORE = 1, FEED_POINT = 2, FEED_UNDO = 3 };
+enum FeedFlag : uint8_t { FEED_SET_TIEBREAK = 1, FEED_MATCH_TIEBREAK = 2, FEED_GAME_END = 4, FEED_MATCH_OVER = 8 };
+
+struct FeedMessage {        // host byte order; subscribers are on the same host
+    uint8_t type;           // FeedType
+    uint8_t flags;          // FeedFlag bits, for the state after the change
+    uint8_t winner;         // FEED_POINT: who won the point (0/1); else 0xFF
+    uint8_t serve;          // FEED_POINT: ServeType of the point
+    uint32_t seq;           // counts every message published
+    uint32_t points;        // points in the log after the change
+    uint8_t set_index;
+    uint8_t server;
+    uint8_t sets_won[2];
+    uint8_t games[2];       // in the current set
+    uint16_t pts[2];        // game points (0,1,2,3,4.. as scored) or tiebreak points
+};
+static_assert(sizeof(FeedMessage) == 24, "feed messages are 24 bytes on the wire");
+
+static const size_t FEED_RING_SIZE = 256;
+static const size_t FEED_CLIENT_QUEUE = 64;   // messages held per subscriber
+static const int FEED_LINGER_MS = 1000;       // at close, for queued messages to go out
+
+struct FeedClient {
+    int fd = -1;
+    deque<FeedMessage> queue;
+    size_t sent = 0;           // bytes of queue.front() already written
+};
+
+struct ScoreFeed {
+    int listen_fd = -1, wake_fd = -1, ep = -1;
+    string path;
+    // Main thread only
+    uint32_t seq = 0;
+    size_t published_points = 0;
+    uint64_t dropped = 0;
+    // Shared with the feed thread
+    unique_ptr<SpscRing<FeedMessage, FEED_RING_SIZE>> ring;
+    thread worker;
+    atomic<bool> stopping{false};
+};
+
+static ScoreFeed feed;
+
+// One gather write of the subscriber's queue; false if it has hung up.
+static bool feed_flush(FeedClient& c) {
+    if (c.queue.empty()) return true;
+    iovec iov[FEED_CLIENT_QUEUE];
+    size_t n = 0;
+    for (const FeedMessage& m : c.queue) {
+        size_t skip = (n == 0 ? c.sent : 0);
+        iov[n].iov_base = (char*)&m + skip;
+        iov[n].iov_len = sizeof(FeedMessage) - skip;
+        n++;
+    }
+    ssize_t w = send_some(c.fd, iov, n);
+    if (w < 0) return false;
+    size_t left = (size_t)w;
+    while (left > 0) {
+        size_t take = min(left, sizeof(FeedMessage) - c.sent);
+        c.sent += take;
+        left -= take;
+        if (c.sent == sizeof(FeedMessage)) { c.queue.pop_front(); c.sent = 0; }
+    }
+    return true;
+}
+
+// Queues m for c. A full queue is written out first, so only a subscriber
+// that is really behind loses messages.
+static void feed_enqueue(FeedClient& c, const FeedMessage& m) {
+    if (c.queue.size() == FEED_CLIENT_QUEUE) feed_flush(c);
+    if (c.queue.size() == FEED_CLIENT_QUEUE)
+        c.queue.erase(c.queue.begin() + (c.sent ? 1 : 0));
+    c.queue.push_back(m);
+}
+
+static void feed_loop() {
+    ConnTable<FeedClient> clients(feed.ep);
+    FeedMessage latest{};
+    bool have_latest = false;
+    epoll_event events[64];
+    chrono::steady_clock::time_point linger_until;
+    bool lingering = false;
+    for (;;) {
+        int timeout = -1;
+        if (lingering)
+            timeout = max(0, (int)chrono::duration_cast<chrono::milliseconds>(linger_until - chrono::steady_clock::now()).count());
+        int n = epoll_wait(feed.ep, events, 64, timeout);
+        if (n < 0 && errno != EINTR) return;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == feed.wake_fd) {
+                uint64_t v;
+                if (read(feed.wake_fd, &v, sizeof(v)) < 0) {}
+                FeedMessage m;
+                while (feed.ring->pop(m)) {
+                    latest = m;
+                    have_latest = true;
+                    clients.for_each([&](FeedClient& c){ feed_enqueue(c, m); });
+                }
+            } else if (fd == feed.listen_fd) {
+                clients.accept_all(feed.listen_fd, [&](FeedClient& c){
+                    if (!have_latest) return;
+                    FeedMessage hello = latest;
+                    hello.type = FEED_SCORE;
+                    hello.winner = 0xFF;
+                    c.queue.push_back(hello);
+                });
+            } else if (clients.find(fd) && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                // Subscribers have nothing to say; input means they hung up
+                char buf[256];
+                ssize_t r = recv(fd, buf, sizeof(buf), 0);
+                if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) clients.drop(fd);
+            }
+        }
+        TraceSpan t("feed fanout");
+        clients.for_each([&](FeedClient& c){
+            if (!feed_flush(c)) clients.drop(c.fd);
+            else clients.want_output(c, !c.queue.empty());
+        });
+        if (feed.stopping.load() && feed.ring->empty()) {
+            bool queued = false;
+            clients.for_each([&](FeedClient& c){ if (!c.queue.empty()) queued = true; });
+            if (!queued || (lingering && chrono::steady_clock::now() >= linger_until)) break;
+            if (!lingering) {
+                lingering = true;
+                linger_until = chrono::steady_clock::now() + chrono::milliseconds(FEED_LINGER_MS);
+            }
+        }
+    }
+}
+
+static bool feed_open(const string& path) {
+    feed.listen_fd = unix_listen(path, 64);
+    if (feed.listen_fd < 0) return false;
+    feed.path = path;
+    feed.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    feed.ep = epoll_create1(EPOLL_CLOEXEC);
+    epoll_watch(feed.ep, feed.listen_fd, EPOLLIN);
+    epoll_watch(feed.ep, feed.wake_fd, EPOLLIN);
+    feed.ring.reset(new SpscRing<FeedMessage, FEED_RING_SIZE>);
+    return true;
+}
+
+// Whether point (the last one in st's log) finished a game or tiebreak: the
+// set or the game count moved on from where the point was played.
+static bool feed_point_ended_game(const MatchState& st, const PointLogEntry& point) {
+    if (st.current_set_index != point.set_index || match_is_over_now(st)) return true;
+    if (point.in_tiebreak) return false;
+    const SetScore& cur = st.sets[st.current_set_index];
+    return cur.games_player1 + cur.games_player2 != point.game_index;
+}
+
+static void feed_push(const MatchState& st, FeedType type, const PointLogEntry* point) {
+    FeedMessage m{};
+    m.type = type;
+    m.seq = ++feed.seq;
+    m.points = (uint32_t)st.log_entries.size();
+    m.winner = point ? (uint8_t)point->point_winner : 0xFF;
+    m.serve = point ? (uint8_t)point->serve_type : 0;
+    m.set_index = (uint8_t)st.current_set_index;
+    m.server = (uint8_t)st.current_server;
+    m.sets_won[0] = (uint8_t)st.sets_won_p1;
+    m.sets_won[1] = (uint8_t)st.sets_won_p2;
+    const SetScore& cur = st.sets[st.current_set_index];
+    m.games[0] = (uint8_t)cur.games_player1;
+    m.games[1] = (uint8_t)cur.games_player2;
+    bool tb = st.in_set_tiebreak || st.in_match_tiebreak10;
+    m.pts[0] = (uint16_t)(tb ? st.tb_points_p1 : st.game_points_p1);
+    m.pts[1] = (uint16_t)(tb ? st.tb_points_p2 : st.game_points_p2);
+    if (st.in_set_tiebreak) m.flags |= FEED_SET_TIEBREAK;
+    if (st.in_match_tiebreak10) m.flags |= FEED_MATCH_TIEBREAK;
+    if (point && feed_point_ended_game(st, *point)) m.flags |= FEED_GAME_END;
+    if (match_is_over_now(st)) m.flags |= FEED_MATCH_OVER;
+    if (!feed.ring->push(m)) feed.dropped++;
+}
+
+// Publishes whatever changed in the log since the last call (or the score
+// itself on the first call).
+static void feed_publish(const MatchState& st) {
+    if (feed.listen_fd < 0) return;
+    if (!feed.worker.joinable()) {
+        feed_push(st, FEED_SCORE, nullptr);
+        feed.worker = thread(feed_loop);
+    }
+    size_t n = st.log_entries.size();
+    if (n < feed.published_points) feed_push(st, FEED_UNDO, nullptr);
+    for (size_t i = feed.published_points; i < n; i++) feed_push(st, FEED_POINT, &st.log_entries[i]);
+    feed.published_points = n;
+    uint64_t one = 1;
+    if (write(feed.wake_fd, &one, sizeof(one)) < 0) {}
+}
+
+static void feed_close() {
+    if (feed.listen_fd < 0) return;
+    if (feed.worker.joinable()) {
+        feed.stopping = true;
+        uint64_t one = 1;
+        if (write(feed.wake_fd, &one, sizeof(one)) < 0) {}
+        feed.worker.join();
+    }
+    close(feed.ep);
+    close(feed.wake_fd);
+    close(feed.listen_fd);
+    unlink(feed.path.c_str());
+    feed.listen_fd = -1;
+    if (feed.dropped) cerr << "Score feed: dropped " << feed.dropped << " messages (feed thread behind)\n";
+}
+
+// --subscribe PATH: prints each feed message as a line until the feed ends.
+static int subscribe_feed(const string& path) {
+    sockaddr_un addr;
+    int fd = -1;
+    if (!unix_address(path, addr) || (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0
+        || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        cerr << "Cannot connect to " << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    static const char* const TYPE_NAMES[] = { "?", "score", "point", "undo" };
+    FeedMessage m;
+    size_t got = 0;
+    for (;;) {
+        ssize_t r = read(fd, (char*)&m + got, sizeof(m) - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+        if (got < sizeof(m)) continue;
+        got = 0;
+        ScoreCore sc;
+        sc.in_set_tiebreak = (m.flags & FEED_SET_TIEBREAK) != 0;
+        sc.in_match_tiebreak10 = (m.flags & FEED_MATCH_TIEBREAK) != 0;
+        sc.game_points_p1 = sc.tb_points_p1 = m.pts[0];
+        sc.game_points_p2 = sc.tb_points_p2 = m.pts[1];
+        string pts1, pts2;
+        point_strings(sc, pts1, pts2);
+        OutBuf& b = scratch_buffer();
+        b << '#' << m.seq << ' ' << TYPE_NAMES[m.type <= FEED_UNDO ? m.type : 0];
+        if (m.type == FEED_POINT) b << " won by P" << (m.winner + 1);
+        b << "  sets " << m.sets_won[0] << '-' << m.sets_won[1] << "  games " << m.games[0] << '-' << m.games[1]
+          << "  " << (pts1.empty() ? "-" : pts1) << ':' << (pts2.empty() ? "-" : pts2)
+          << "  P" << (m.server + 1) << " serving";
+        if (m.flags & (FEED_SET_TIEBREAK | FEED_MATCH_TIEBREAK)) b << "  tiebreak";
+        if (m.flags & FEED_GAME_END) b << "  game";
+        if (m.flags & FEED_MATCH_OVER) b << "  final";
+        b << '\n';
+        write_stdout(b);
+        cout.flush();
+    }
+    close(fd);
+    return 0;
+}
+
+#else
+static bool feed_open(const string&) { errno = ENOSYS; return false; }
+static void feed_publish(const MatchState&) {}
+static void feed_close() {}
+#endif // HAVE_EPOLL
+
+// =============== HTTP scoreboard ===============
+// --http [HOST:]PORT answers GET /score, /stats (match totals, or ?set=N)
+// and /points (all, or ?from=K onwards) with JSON. It is for phones and
+// boards on the venue network. One thread runs a non-blocking epoll loop
+// over every connection, with keep-alive and pipelined requests. The
+// scoring loop only copies the new score, the stats and the new log entry
+// into an HttpUpdate on an SpscRing. The HTTP thread applies these to its
+// own mirror of the match. It renders each response body once per change
+// and shares it with every request until the next change. /points?from=K
+// sends a slice of one pre-rendered array.
+#ifdef HAVE_EPOLL
+
+static const size_t HTTP_RING_SIZE = 128;
+static const size_t HTTP_MAX_REQUEST = 8192;      // header bytes; more gets 431
+static const size_t HTTP_MAX_PENDING = 1u << 20;  // unread response bytes before we give up on a client
+
+struct HttpUpdate {
+    size_t points = 0;                  // log length after the change
+    PointLogEntry entry;                // the new last point, when there is exactly one
+    shared_ptr<const vector<PointLogEntry>> log;   // otherwise (or after a lost update): the whole log
+    ShmScore score;
+    int set_count = 0;
+    PlayerStats match[2];
+    PlayerStats sets[SHM_MAX_SETS][2];
+};
+
+// The HTTP thread's copy of the match, built from HttpUpdates
+struct HttpMirror {
+    uint64_t version = 0;               // bumped by every update applied
+    ShmScore score{};
+    int set_count = 0;
+    PlayerStats match[2];
+    PlayerStats sets[SHM_MAX_SETS][2];
+    vector<PointLogEntry> log;
+};
+
+// A rendered body and the mirror version it was rendered from. Replies hold
+// their own reference, so a rebuild never pulls a body out from under one.
+struct HttpBody {
+    uint64_t version = 0;
+    shared_ptr<const string> text;
+};
+
+struct HttpReply {
+    string head;                        // status line, headers and any body prefix
+    shared_ptr<const string> body;
+    size_t off = 0, len = 0;            // the slice of *body sent after head
+    size_t sent = 0;                    // bytes of head + slice written
+};
+
+struct HttpConn {
+    int fd = -1;
+    string in;
+    deque<HttpReply> out;
+    size_t out_bytes = 0;
+    bool closing = false;
+};
+
+struct HttpServer {
+    int listen_fd = -1, wake_fd = -1, ep = -1;
+    // Main thread only
+    size_t published_points = 0;
+    bool resync = false;                // an update was lost; send the whole log next
+    // Shared with the HTTP thread
+    unique_ptr<SpscRing<HttpUpdate, HTTP_RING_SIZE>> ring;
+    thread worker;
+    atomic<bool> stopping{false};
+    // HTTP thread only
+    HttpMirror mirror;
+    HttpBody score_body, points_body, stats_body[SHM_MAX_SETS + 1];
+    vector<size_t> point_offsets;       // where each point starts in points_body
+};
+
+static HttpServer http;
+
+static void http_apply(HttpUpdate& u) {
+    HttpMirror& m = http.mirror;
+    if (u.log) m.log = *u.log;
+    else if (u.points < m.log.size()) m.log.resize(u.points);
+    else if (u.points == m.log.size() + 1) m.log.push_back(std::move(u.entry));
+    m.score = u.score;
+    m.set_count = u.set_count;
+    m.match[0] = u.match[0];
+    m.match[1] = u.match[1];
+    memcpy(m.sets, u.sets, sizeof(m.sets));
+    m.version++;
+}
+
+static void http_json_string(OutBuf& b, const char* s) {
+    b << '"';
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') b << '\\';
+        if ((unsigned char)*s >= 0x20) b << *s;
+    }
+    b << '"';
+}
+
+static void http_render_score(OutBuf& b) {
+    const ShmScore& s = http.mirror.score;
+    b << "{\"players\":[";
+    http_json_string(b, s.player[0]);
+    b << ',';
+    http_json_string(b, s.player[1]);
+    b << "],\"sets\":[";
+    for (int i = 0; i < s.set_count; i++) {
+        b << (i ? "," : "") << "{\"p1\":" << s.games[i][0] << ",\"p2\":" << s.games[i][1];
+        if (s.set_tb_points[i][0] >= 0) b << ",\"tb_p1\":" << s.set_tb_points[i][0] << ",\"tb_p2\":" << s.set_tb_points[i][1];
+        b << '}';
+    }
+    b << "],\"sets_won\":[" << s.sets_won[0] << ',' << s.sets_won[1] << "],\"points\":[";
+    http_json_string(b, s.points[0]);
+    b << ',';
+    http_json_string(b, s.points[1]);
+    b << "],\"server\":" << (s.server == 0 ? "\"P1\"" : "\"P2\"")
+      << ",\"tb\":" << (s.tiebreak == 1 ? "\"set\"" : s.tiebreak == 2 ? "\"match\"" : "null")
+      << ",\"match_over\":" << (s.match_over ? "true" : "false")
+      << ",\"points_played\":" << s.points_played << "}\n";
+}
+
+static void http_render_stats(OutBuf& b, int set) {
+    const HttpMirror& m = http.mirror;
+    const PlayerStats* ps = set ? m.sets[set - 1] : m.match;
+    b << "{\"set\":";
+    if (set) b << set; else b << "null";
+    for (int p = 0; p < 2; p++) {
+        b << (p ? ",\"p2\":{" : ",\"p1\":{");
+        for (int i = 0; i < STAT_FIELD_COUNT; i++)
+            b << (i ? ",\"" : "\"") << STAT_FIELD_NAMES[i] << "\":" << ps[p].*STAT_FIELDS[i];
+        b << '}';
+    }
+    b << "}\n";
+}
+
+static void http_render_points(OutBuf& b) {
+    http.point_offsets.clear();
+    b << '[';
+    for (size_t i = 0; i < http.mirror.log.size(); i++) {
+        if (i) b << ",\n";
+        http.point_offsets.push_back(b.data.size());
+        render_point_json(b, http.mirror.log[i], i + 1);
+    }
+    b << "]\n";
+}
+
+// Returns body, re-rendered first if the mirror has changed since.
+static const shared_ptr<const string>& http_body(HttpBody& body, const function<void(OutBuf&)>& render) {
+    if (!body.text || body.version != http.mirror.version) {
+        TraceSpan t("render http");
+        OutBuf b;
+        render(b);
+        body.text = make_shared<const string>(std::move(b.data));
+        body.version = http.mirror.version;
+    }
+    return body.text;
+}
+
+static void http_reply(HttpConn& c, int status, const char* reason, bool head_only,
+                       const char* prefix, shared_ptr<const string> body, size_t off, size_t len) {
+    HttpReply r;
+    size_t prefix_len = strlen(prefix);
+    OutBuf h;
+    h << "HTTP/1.1 " << status << ' ' << reason
+      << "\r\nContent-Type: application/json\r\nCache-Control: no-store\r\nAccess-Control-Allow-Origin: *\r\nContent-Length: "
+      << (prefix_len + len) << (c.closing ? "\r\nConnection: close\r\n\r\n" : "\r\n\r\n");
+    if (!head_only) {
+        h << prefix;
+        r.body = std::move(body);
+        r.off = off;
+        r.len = len;
+    }
+    r.head = std::move(h.data);
+    c.out_bytes += r.head.size() + r.len;
+    c.out.push_back(std::move(r));
+}
+
+static void http_error(HttpConn& c, int status, const char* reason, bool head_only) {
+    string body = string("{\"error\":\"") + reason + "\"}\n";
+    http_reply(c, status, reason, head_only, body.c_str(), nullptr, 0, 0);
+}
+
+// Strict non-negative decimal, as used in query strings
+static bool http_parse_uint(const string& s, size_t& v) {
+    if (s.empty() || s.size() > 9) return false;
+    v = 0;
+    for (char ch : s) {
+        if (ch < '0' || ch > '9') return false;
+        v = v * 10 + (size_t)(ch - '0');
+    }
+    return true;
+}
+
+static bool http_query_param(const string& query, const char* key, string& value) {
+    size_t klen = strlen(key), pos = 0;
+    while (pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == string::npos) end = query.size();
+        if (end - pos > klen && query.compare(pos, klen, key) == 0 && query[pos + klen] == '=') {
+            value = query.substr(pos + klen + 1, end - pos - klen - 1);
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+static void http_handle(HttpConn& c, const string& method, const string& target) {
+    bool head_only = (method == "HEAD");
+    if (method != "GET" && !head_only) {
+        // Any request body would be read as the next request, so hang up
+        c.closing = true;
+        http_error(c, 405, "Method Not Allowed", false);
+        return;
+    }
+    size_t q = target.find('?');
+    string path = target.substr(0, q);
+    string query = (q == string::npos) ? string() : target.substr(q + 1);
+    string arg;
+    bool known = (path == "/score" || path == "/stats" || path == "/points");
+    if (known && http.mirror.version == 0) {
+        http_error(c, 503, "No match yet", head_only);
+    } else if (path == "/score") {
+        const auto& body = http_body(http.score_body, http_render_score);
+        http_reply(c, 200, "OK", head_only, "", body, 0, body->size());
+    } else if (path == "/stats") {
+        size_t set = 0;
+        if (http_query_param(query, "set", arg) && !http_parse_uint(arg, set)) { http_error(c, 400, "Bad Request", head_only); return; }
+        if (set > (size_t)http.mirror.set_count) { http_error(c, 404, "Not Found", head_only); return; }
+        const auto& body = http_body(http.stats_body[set], [set](OutBuf& b){ http_render_stats(b, (int)set); });
+        http_reply(c, 200, "OK", head_only, "", body, 0, body->size());
+    } else if (path == "/points") {
+        size_t from = 1;
+        if (http_query_param(query, "from", arg) && (!http_parse_uint(arg, from) || from == 0)) { http_error(c, 400, "Bad Request", head_only); return; }
+        const auto& body = http_body(http.points_body, http_render_points);
+        if (from > http.point_offsets.size()) { http_reply(c, 200, "OK", head_only, "[]\n", nullptr, 0, 0); return; }
+        size_t off = http.point_offsets[from - 1];
+        http_reply(c, 200, "OK", head_only, "[", body, off, body->size() - off);
+    } else {
+        http_error(c, 404, "Not Found", head_only);
+    }
+}
+
+// Answers every complete request in c.in; false on a malformed one (which
+// still gets its error reply before the connection closes).
+static bool http_read_requests(HttpConn& c) {
+    for (;;) {
+        size_t end = c.in.find("\r\n\r\n");
+        if (end == string::npos) {
+            if (c.in.size() > HTTP_MAX_REQUEST) { c.closing = true; http_error(c, 431, "Request Header Fields Too Large", false); return false; }
+            return true;
+        }
+        string head = c.in.substr(0, end);
+        c.in.erase(0, end + 4);
+        size_t sp1 = head.find(' ');
+        size_t sp2 = (sp1 == string::npos) ? string::npos : head.find(' ', sp1 + 1);
+        size_t eol = head.find("\r\n");
+        if (sp2 == string::npos || (eol != string::npos && sp2 > eol)) { c.closing = true; http_error(c, 400, "Bad Request", false); return false; }
+        string version = head.substr(sp2 + 1, (eol == string::npos ? head.size() : eol) - sp2 - 1);
+        string lower = head;
+        for (char& ch : lower) ch = (char)tolower((unsigned char)ch);
+        if (version == "HTTP/1.0" ? lower.find("\r\nconnection: keep-alive") == string::npos
+                                  : lower.find("\r\nconnection: close") != string::npos)
+            c.closing = true;
+        http_handle(c, head.substr(0, sp1), head.substr(sp1 + 1, sp2 - sp1 - 1));
+        if (c.closing) return true;
+    }
+}
+
+// Sends queued replies, head and body slice of each gathered into one
+// write, until the socket is full; false if the client has hung up.
+static bool http_flush(HttpConn& c) {
+    while (!c.out.empty()) {
+        iovec iov[32];
+        size_t n = 0;
+        for (size_t i = 0; i < c.out.size() && n + 2 <= 32; i++) {
+            const HttpReply& r = c.out[i];
+            size_t skip = (i == 0 ? r.sent : 0);
+            if (skip < r.head.size()) {
+                iov[n].iov_base = (char*)r.head.data() + skip;
+                iov[n++].iov_len = r.head.size() - skip;
+                skip = 0;
+            } else {
+                skip -= r.head.size();
+            }
+            if (r.len > skip) {
+                iov[n].iov_base = (char*)r.body->data() + r.off + skip;
+                iov[n++].iov_len = r.len - skip;
+            }
+        }
+        ssize_t w = send_some(c.fd, iov, n);
+        if (w < 0) return false;
+        size_t left = (size_t)w;
+        c.out_bytes -= left;
+        while (left > 0) {
+            HttpReply& r = c.out.front();
+            size_t take = min(left, r.head.size() + r.len - r.sent);
+            r.sent += take;
+            left -= take;
+            if (r.sent == r.head.size() + r.len) c.out.pop_front();
+        }
+        if (!c.out.empty()) return true;   // socket full; wait for EPOLLOUT
+    }
+    return true;
+}
+
+static bool http_read(HttpConn& c) {
+    char buf[4096];
+    for (;;) {
+        ssize_t r = recv(c.fd, buf, sizeof(buf), 0);
+        if (r > 0) {
+            if (c.closing) continue;   // discard anything after the last request
+            c.in.append(buf, (size_t)r);
+            if (!http_read_requests(c)) return true;
+            continue;
+        }
+        if (r == 0) return false;
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+}
+
+static void http_loop() {
+    ConnTable<HttpConn> conns(http.ep);
+    epoll_event events[64];
+    while (!http.stopping.load()) {
+        int n = epoll_wait(http.ep, events, 64, -1);
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == http.wake_fd) {
+                uint64_t v;
+                if (read(http.wake_fd, &v, sizeof(v)) < 0) {}
+                HttpUpdate u;
+                while (http.ring->pop(u)) http_apply(u);
+                continue;
+            }
+            if (fd == http.listen_fd) {
+                conns.accept_all(http.listen_fd, [](HttpConn&){});
+                continue;
+            }
+            HttpConn* c = conns.find(fd);
+            if (!c) continue;
+            bool keep = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) keep = http_read(*c);
+            keep = http_flush(*c) && keep && c->out_bytes <= HTTP_MAX_PENDING;
+            if (!keep || (c->closing && c->out.empty())) { conns.drop(fd); continue; }
+            conns.want_output(*c, !c->out.empty());
+        }
+    }
+}
+
+static bool http_open(const string& spec) {
+    string host = "0.0.0.0", port = spec;
+    size_t colon = spec.rfind(':');
+    if (colon != string::npos) { host = spec.substr(0, colon); port = spec.substr(colon + 1); }
+    size_t p = 0;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (!http_parse_uint(port, p) || p == 0 || p > 65535 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return false;
+    }
+    addr.sin_port = htons((uint16_t)p);
+    http.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    if (http.listen_fd < 0 || setsockopt(http.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0
+        || ::bind(http.listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(http.listen_fd, 128) != 0) {
+        if (http.listen_fd >= 0) { int e = errno; close(http.listen_fd); errno = e; }
+        http.listen_fd = -1;
+        return false;
+    }
+    http.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    http.ep = epoll_create1(EPOLL_CLOEXEC);
+    epoll_watch(http.ep, http.listen_fd, EPOLLIN);
+    epoll_watch(http.ep, http.wake_fd, EPOLLIN);
+    http.ring.reset(new SpscRing<HttpUpdate, HTTP_RING_SIZE>);
+    return true;
+}
+
+// Starts answering requests, once the command line has been read (so the
+// thread sees --trace). Until the first update there is no match to show.
+static void http_start() {
+    if (http.listen_fd >= 0 && !http.worker.joinable()) http.worker = thread(http_loop);
+}
+
+// Hands the HTTP thread whatever changed since the last call.
+static void http_publish(const MatchState& st) {
+    if (http.listen_fd < 0) return;
+    size_t n = st.log_entries.size();
+    HttpUpdate u;
+    u.points = n;
+    fill_shm_score(u.score, st);
+    u.set_count = (int)min(st.sets.size(), (size_t)SHM_MAX_SETS);
+    u.match[0] = st.match_stats_p1;
+    u.match[1] = st.match_stats_p2;
+    for (int i = 0; i < u.set_count; i++) {
+        u.sets[i][0] = st.per_set_stats_p1[i];
+        u.sets[i][1] = st.per_set_stats_p2[i];
+    }
+    if (!http.resync && n == http.published_points + 1) u.entry = st.log_entries.back();
+    else if (http.resync || n > http.published_points) u.log = make_shared<const vector<PointLogEntry>>(st.log_entries);
+    http.resync = !http.ring->push(std::move(u));
+    http.published_points = n;
+    uint64_t one = 1;
+    if (write(http.wake_fd, &one, sizeof(one)) < 0) {}
+}
+
+static void http_close() {
+    if (http.listen_fd < 0) return;
+    if (http.worker.joinable()) {
+        http.stopping = true;
+        uint64_t one = 1;
+        if (write(http.wake_fd, &one, sizeof(one)) < 0) {}
+        http.worker.join();
+    }
+    close(http.ep);
+    close(http.wake_fd);
+    close(http.listen_fd);
+    http.listen_fd = -1;
+}
+
+#else
+static bool http_open(const string&) { errno = ENOSYS; return false; }
+static void http_start() {}
+static void http_publish(const MatchState&) {}
+static void http_close() {}
+#endif // HAVE_EPOLL
+
+// After every change of score: everything that mirrors it outside the
+// terminal.
+static void publish_match_update(const MatchState& st) {
+    live_stream_sync(st);
+    shm_board.publish(st);
+    feed_publish(st);
+    http_publish(st);
+}
+
+// =============== Trace output ===============
+// --trace FILE writes the spans from the Instrumentation section as a Chrome
+// trace-event JSON array; open it in Perfetto or chrome://tracing. A
+// background thread empties the per-thread rings every TRACE_DRAIN_MS, so a
+// ring only has to hold that long's worth of spans.
+
+static const int TRACE_DRAIN_MS = 50;
+
+struct TraceWriter {
+    FILE* file = nullptr;
+    uint64_t origin_ns = 0;
+    size_t named_threads = 0;
+    bool first = true;
+    thread drainer;
+    mutex m;
+    condition_variable cv;
+    bool stopping = false;
+};
+
+static TraceWriter tracer;
+
+static void trace_separator(OutBuf& b) {
+    b << (tracer.first ? "\n" : ",\n");
+    tracer.first = false;
+}
+
+// Only the drainer thread calls this, or trace_close once it has joined.
+// Uses its own buffer: the final drain can run from atexit, after the main
+// thread's scratch buffer is gone.
+static void trace_drain() {
+    vector<TraceRing*> rings;
+    {
+        lock_guard<mutex> lk(trace_rings_mutex);
+        for (const auto& r : trace_rings) rings.push_back(r.get());
+    }
+    OutBuf b;
+    for (; tracer.named_threads < rings.size(); tracer.named_threads++) {
+        int tid = rings[tracer.named_threads]->tid();
+        trace_separator(b);
+        b << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\"";
+        if (tid == 1) b << "main";
+        else b << "worker " << (tid - 1);
+        b << "\"}}";
+    }
+    for (TraceRing* r : rings) {
+        r->drain([&](const TraceEvent& e) {
+            uint64_t start = e.start_ns > tracer.origin_ns ? e.start_ns - tracer.origin_ns : 0;
+            trace_separator(b);
+            b << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << r->tid()
+              << ",\"ts\":" << Fixed{start / 1000.0, 3} << ",\"dur\":" << Fixed{e.dur_ns / 1000.0, 3} << '}';
+        });
+    }
+    if (!b.data.empty()) fwrite(b.data.data(), 1, b.data.size(), tracer.file);
+}
+
+static void trace_close() {
+    if (!tracer.file) return;
+    {
+        lock_guard<mutex> lk(tracer.m);
+        tracer.stopping = true;
+    }
+    tracer.cv.notify_one();
+    tracer.drainer.join();
+    trace_drain();
+    fputs("\n]\n", tracer.file);
+    fclose(tracer.file);
+    tracer.file = nullptr;
+    if (uint64_t lost = trace_dropped.load())
+        cerr << "Trace: dropped " << lost << " spans (ring full)\n";
+}
+
+// Must run before any other thread starts, so they all see trace_enabled.
+// The file is finished by trace_close, at the latest from atexit.
+static bool trace_open(const string& path) {
+    tracer.file = fopen(path.c_str(), "w");
+    if (!tracer.file) return false;
+    fputs("[", tracer.file);
+    tracer.origin_ns = now_ns();
+    this_thread_trace_ring();   // the main thread is tid 1
+    trace_enabled = true;
+    atexit(trace_close);
+    tracer.drainer = thread([]{
+        unique_lock<mutex> lk(tracer.m);
+        while (!tracer.stopping) {
+            tracer.cv.wait_for(lk, chrono::milliseconds(TRACE_DRAIN_MS));
+            trace_drain();
+        }
+    });
+    return true;
+}
+
+// =============== Menus ===============
 
 static void print_format_menu() {
     cout << "Choose match format:\n";
@@ -726,14 +4710,85 @@ static void print_format_menu() {
     cout << "  3) Best-of-3 short sets to 4 (TB7 at 4-4)\n";
 }
 
-static FormatConfig get_format_by_choice(int c) {
-    FormatConfig fc;
-    if (c==1) { fc.games_to_win_set=6; fc.tiebreak_at_games=6; fc.set_tiebreak_points=7; fc.deciding=DECIDING_REGULAR; fc.deciding_tb_points=10; }
-    else if (c==2){ fc.games_to_win_set=6; fc.tiebreak_at_games=6; fc.set_tiebreak_points=7; fc.deciding=DECIDING_TB10; fc.deciding_tb_points=10; }
-    else          { fc.games_to_win_set=4; fc.tiebreak_at_games=4; fc.set_tiebreak_points=7; fc.deciding=DECIDING_REGULAR; fc.deciding_tb_points=10; }
-    return fc;
+// p50/p99/p99.9/max per phase, in microseconds.
+static void show_phase_timings() {
+    OutBuf& o = scratch_buffer();
+    o << "\nPhase timings (us)\n  phase               count       p50       p99     p99.9       max\n";
+    for (int p=0;p<PHASE_COUNT;p++) {
+        const LatencyHistogram& h = phase_histograms[p];
+        size_t start = o.data.size();
+        o << "  " << PHASE_NAMES[p]; pad_from(o, start, 14);
+        char buf[FORMAT_BUF];
+        int n = format_int(buf, (long long)h.count());
+        o << string(max(0, 11 - n), ' ') << string(buf, n);
+        const uint64_t vals[4] = { h.percentile(0.50), h.percentile(0.99), h.percentile(0.999), h.max() };
+        for (uint64_t v : vals) {
+            n = format_fixed(buf, v / 1000.0, 1);
+            o << string(max(0, 10 - n), ' ') << string(buf, n);
+        }
+        o << '\n';
+    }
+    write_stdout(o);
+}
+
+// Allocation reports (TENNIS_ALLOC_STATS builds only, on stderr): a line per
+// point entered, from the first menu to the score update, and per-site
+// totals for the match at exit.
+#ifdef TENNIS_ALLOC_STATS
+struct AllocSnapshot { long long count[SITE_COUNT], bytes[SITE_COUNT]; };
+
+static AllocSnapshot alloc_snapshot() {
+    AllocSnapshot a;
+    for (int i=0;i<SITE_COUNT;i++) {
+        a.count[i] = site_alloc_count[i].load(memory_order_relaxed);
+        a.bytes[i] = site_alloc_bytes[i].load(memory_order_relaxed);
+    }
+    return a;
 }
 
+static long long alloc_points_entered = 0, alloc_free_points = 0;
+
+static void write_alloc_sites(OutBuf& o, const AllocSnapshot& before, const AllocSnapshot& after) {
+    for (int i=0;i<SITE_COUNT;i++) {
+        long long n = after.count[i] - before.count[i];
+        if (n) o << "  " << SITE_NAMES[i] << ' ' << n << " (" << after.bytes[i] - before.bytes[i] << " B)";
+    }
+}
+
+class PointAllocReport {
+public:
+    explicit PointAllocReport(const MatchState& st) : st_(st), before_(alloc_snapshot()) {}
+    ~PointAllocReport() {
+        AllocSnapshot after = alloc_snapshot();
+        long long n = 0, bytes = 0;
+        for (int i=0;i<SITE_COUNT;i++) { n += after.count[i] - before_.count[i]; bytes += after.bytes[i] - before_.bytes[i]; }
+        alloc_points_entered++;
+        if (n == 0) alloc_free_points++;
+        OutBuf o;
+        o << "[alloc] point " << (long long)st_.log_entries.size() << ": " << n << " allocs, " << bytes << " B";
+        write_alloc_sites(o, before_, after);
+        o << '\n';
+        fwrite(o.data.data(), 1, o.data.size(), stderr);
+    }
+private:
+    const MatchState& st_;
+    AllocSnapshot before_;
+};
+
+static void alloc_report_match() {
+    AllocSnapshot zero = {}, now = alloc_snapshot();
+    OutBuf o;
+    o << "[alloc] match: " << alloc_free_points << " of " << alloc_points_entered
+      << " points entered without allocating; by site:";
+    write_alloc_sites(o, zero, now);
+    o << '\n';
+    fwrite(o.data.data(), 1, o.data.size(), stderr);
+}
+#else
+struct PointAllocReport { explicit PointAllocReport(const MatchState&) {} };
+static void alloc_report_match() {}
+#endif
+
 static void print_stats_menu() {
     cout << "\nStats Menu\n";
     cout << "  1) Match totals (choose player or both)\n";
@@ -745,34 +4800,26 @@ static void print_stats_menu() {
 static void show_match_totals(const MatchState& st) {
     cout << "Show stats for: 1) " << st.player1_name
          << "  2) " << st.player2_name << "  3) Both\n";
-    int c; cin>>c;
-    if (c==1) print_single_player_stats(st.match_stats_p1, "== "+st.player1_name+" (Match Totals) ==");
-    else if (c==2) print_single_player_stats(st.match_stats_p2, "== "+st.player2_name+" (Match Totals) ==");
-    else if (c==3) print_side_by_side(st.match_stats_p1, st.match_stats_p2, st.player1_name, st.player2_name);
+    int c=read_choice();
+    if (c==1) show_player_stats(st, -1, 0, "== "+st.player1_name+" (Match Totals) ==");
+    else if (c==2) show_player_stats(st, -1, 1, "== "+st.player2_name+" (Match Totals) ==");
+    else if (c==3) show_both_stats(st, -1);
 }
 
 static void show_by_set(const MatchState& st) {
     cout << "Which set? (1-" << st.sets.size() << "): ";
-    int s; cin>>s; if (s<1 || s>(int)st.sets.size()) return; int idx=s-1;
+    int s=read_choice(); if (s<1 || s>(int)st.sets.size()) return; int idx=s-1;
     cout << "Show stats for: 1) " << st.player1_name << "  2) " << st.player2_name << "  3) Both\n";
-    int c; cin>>c;
-    if (c==1) print_single_player_stats(st.per_set_stats_p1[idx], "== "+st.player1_name+" (Set "+to_string(s)+") ==");
-    else if (c==2) print_single_player_stats(st.per_set_stats_p2[idx], "== "+st.player2_name+" (Set "+to_string(s)+") ==");
-    else if (c==3) print_side_by_side(st.per_set_stats_p1[idx], st.per_set_stats_p2[idx], st.player1_name, st.player2_name);
+    int c=read_choice();
+    if (c==1) show_player_stats(st, idx, 0, "== "+st.player1_name+" (Set "+to_string(s)+") ==");
+    else if (c==2) show_player_stats(st, idx, 1, "== "+st.player2_name+" (Set "+to_string(s)+") ==");
+    else if (c==3) show_both_stats(st, idx);
 }
 
 static void show_point_by_point(const MatchState& st) {
-    cout << "# | Set | Game | TB | Server | Serve | Winner | BP/GP/SP/MP | Event\n";
-    for (size_t i=0;i<st.log_entries.size();i++) {
-        const auto& e=st.log_entries[i];
-        cout<<(i+1)<<" | "<<(e.set_index+1)<<" | "<<(e.game_index+1)<<" | "<<(e.in_tiebreak?"Y":"N")
-            <<" | "<<(e.server_player==0?st.player1_name:st.player2_name)<<" | "
-            <<(e.serve_type==SERVE_FIRST?"1st":(e.serve_type==SERVE_SECOND?"2nd":"-"))<<" | "
-            <<(e.point_winner==0?st.player1_name:st.player2_name)<<" | "
-            <<(e.was_break_point?"BP":"")<<(e.was_game_point?" GP":"")
-            <<(e.was_set_point?" SP":"")<<(e.was_match_point?" MP":"")
-            <<" | "<<e.event_chain<<"\n";
-    }
+    OutBuf& o = scratch_buffer();
+    render_point_log_table(o, st);
+    write_stdout(o);
 }
 
 // =============== Menus for point recording ===============
@@ -806,357 +4853,780 @@ static void print_rally_menu() {
     cout << "  6) Returner forced error (drawn by server)\n";
 }
 
-// =============== Core point logic ===============
+// =============== Point entry ===============
 
-static void give_point_regular(MatchState& st, int winner_player) {
-    if (winner_player==0) st.game_points_p1++; else st.game_points_p2++;
-    int p1=st.game_points_p1, p2=st.game_points_p2;
-    if (p1>=4 || p2>=4) {
-        if (abs(p1-p2)>=2) {
-            int game_winner = (p1>p2?0:1);
-            award_game(st, game_winner);
-            if (!st.in_match_tiebreak10 && check_enter_set_tiebreak(st)) {
-                st.in_set_tiebreak=true;
-                st.sets[st.current_set_index].set_tiebreak_played=true;
-                st.tb_points_p1=0; st.tb_points_p2=0;
-                // who serves first in set tiebreak? the next to serve — which is current_server now
-                st.tb_start_server = st.current_server;
-            }
-            int set_winner=-1;
-            if (!st.in_set_tiebreak) {
-                if (set_is_won_now(st, set_winner)) {
-                    close_set_and_prepare_next(st, set_winner);
-                }
-            }
-        }
+// Asks the question for the entry's current stage.
+static void prompt_point_entry(const MatchState& st, EntryStage stage) {
+    switch (stage) {
+    case ENTRY_SERVE: print_scoreboard(st); print_serve_menu(); cout << "Choose: "; break;
+    case ENTRY_SECOND: cout<<"Second serve: 1) in  2) double fault\n"; break;
+    case ENTRY_RETURN: print_scoreboard(st); print_return_menu(); cout<<"Choose: "; break;
+    case ENTRY_RALLY: print_scoreboard(st); print_rally_menu(); cout<<"Choose: "; break;
+    case ENTRY_NET: cout<<"Mark net point? 1) No  2) Yes\n"; break;
+    case ENTRY_NET_PLAYER: cout<<"Who was at net? 1) "<<st.player1_name<<"  2) "<<st.player2_name<<"\n"; break;
+    default: break;
     }
 }
 
-static void give_point_tiebreak(MatchState& st, int winner_player, bool is_set_tb) {
-    if (winner_player==0) st.tb_points_p1++; else st.tb_points_p2++;
-    if (is_set_tb) {
-        int set_winner=-1;
-        if (set_is_won_now(st, set_winner)) {
-            st.sets[st.current_set_index].tb_points_p1=st.tb_points_p1;
-            st.sets[st.current_set_index].tb_points_p2=st.tb_points_p2;
-            st.in_set_tiebreak=false;
-            close_set_and_prepare_next(st, set_winner);
-        }
-    } else {
-        int mw=-1;
-        if (match_tiebreak10_won(st, mw)) {
-            if (mw==0) st.sets_won_p1++; else st.sets_won_p2++;
-            // add a final “set row” to display TB10 as a decider visually
-            SetScore fin;
-            fin.games_player1 = st.sets.back().games_player1;
-            fin.games_player2 = st.sets.back().games_player2;
-            fin.set_tiebreak_played = true;
-            fin.tb_points_p1 = st.tb_points_p1;
-            fin.tb_points_p2 = st.tb_points_p2;
-            st.sets.push_back(fin);
-            // inside match_tiebreak10_won(...) right after: st.sets.push_back(fin);
-            st.per_set_stats_p1.push_back(PlayerStats());
-            st.per_set_stats_p2.push_back(PlayerStats());
-            st.in_match_tiebreak10=false;
+// Walks the serve/return/rally menus. Returns false if the point was
+// abandoned from the admin menu (undo or end) instead.
+static bool read_point_event(MatchState& st, PointEvent& ev) {
+    PointEntry entry;
+    for (;;) {
+        prompt_point_entry(st, entry.stage());
+        EntryResult r = entry.feed(read_choice());
+        if (r == ENTRY_COMPLETE) { ev = entry.event(); return true; }
+        if (r == ENTRY_INVALID) { cout<<"Invalid option.\n"; continue; }
+        if (r != ENTRY_ADMIN) continue;
+
+        cout << "\nAdmin: 1) Stats  2) Undo last point  3) End match  4) Back  5) Timings\n";
+        int a=read_choice();
+        if (a==1) {
+            bool back=false;
+            while(!back){
+                print_stats_menu();
+                int sm=read_choice();
+                if (sm==1) show_match_totals(st);
+                else if (sm==2) show_by_set(st);
+                else if (sm==3) show_point_by_point(st);
+                else back=true;
+            }
+        } else if (a==2) {
+            if (!pop_history(st)) cout<<"Nothing to undo.\n";
+            else cout<<"Undid last point.\n";
+            return false;
+        } else if (a==3) {
+            return false;
+        } else if (a==5) {
+            show_phase_timings();
         }
     }
 }
 
 static void record_point_and_stats(MatchState& st) {
-    push_history(st);
-
     // If in tiebreak, enforce correct server for THIS point.
     if (st.in_set_tiebreak || st.in_match_tiebreak10) {
         compute_tiebreak_server(st);
     }
+    PointEvent ev;
+    if (read_point_event(st, ev)) apply_point_event(st, ev);
+}
 
-    // Flags before point (regular games only)
-    bool was_break_point=false, was_game_point=false, was_set_point=false, was_match_point=false;
-    if (!st.in_set_tiebreak && !st.in_match_tiebreak10) {
-        was_break_point = is_break_point_if_receiver_wins(st);
-        bool gp_p1 = is_game_point_for(st.game_points_p1, st.game_points_p2);
-        bool gp_p2 = is_game_point_for(st.game_points_p2, st.game_points_p1);
-        was_game_point = (gp_p1 || gp_p2);
-        was_set_point = (is_set_point_if_player_wins(st,0) || is_set_point_if_player_wins(st,1));
-        was_match_point = (is_match_point_if_player_wins(st,0) || is_match_point_if_player_wins(st,1));
+// =============== Match simulation ===============
+// Plays whole matches through the same scoring engine as live entry
+// (give_point_regular / give_point_tiebreak) with a fixed serve-point win
+// rate per player. Each match draws from its own counter-based stream keyed
+// on (seed, match number), so the results do not depend on the thread count
+// or on which thread picked up which batch.
+
+struct SimConfig {
+    long long matches = 0;
+    double serve_rate[2] = {0.64, 0.62};
+    int format_choice = 1;
+    int threads = 0;   // 0 = one per core
+    uint64_t seed = 1;
+};
+
+static const long long SIM_BATCH = 4096;   // matches claimed per trip to the shared counter
+static const int SIM_MAX_POINTS = 1024;    // longer matches share the last length bucket
+
+// One per thread, padded so neighbours do not share a cache line.
+struct alignas(64) SimTotals {
+    long long matches=0, p1_wins=0, straight_sets=0, tiebreaks=0, points=0;
+    long long final_sets[4][4] = {};   // [sets won by P1][sets won by P2]
+    vector<long long> length_hist = vector<long long>(SIM_MAX_POINTS + 1, 0);
+
+    void add(const SimTotals& o) {
+        matches += o.matches; p1_wins += o.p1_wins; straight_sets += o.straight_sets;
+        tiebreaks += o.tiebreaks; points += o.points;
+        for (int i=0;i<4;i++) for (int j=0;j<4;j++) final_sets[i][j] += o.final_sets[i][j];
+        for (int i=0;i<=SIM_MAX_POINTS;i++) length_hist[i] += o.length_hist[i];
     }
+};
 
-    PointLogEntry entry;
-    entry.set_index = st.current_set_index;
-    entry.game_index = st.sets[st.current_set_index].games_player1 + st.sets[st.current_set_index].games_player2;
-    entry.in_tiebreak = (st.in_set_tiebreak || st.in_match_tiebreak10);
-    entry.tiebreak_point_number = (st.tb_points_p1 + st.tb_points_p2 + 1);
-    entry.point_number_in_game = (st.game_points_p1 + st.game_points_p2 + 1);
-    entry.server_player = st.current_server;
+// Back to 0-0 in set 1, keeping the vectors' capacity.
+static void sim_reset(MatchState& st, int first_server) {
+    st.sets.clear();
+    st.per_set_stats_p1.clear();
+    st.per_set_stats_p2.clear();
+    st.sets_won_p1 = st.sets_won_p2 = 0;
+    st.in_set_tiebreak = st.in_match_tiebreak10 = false;
+    st.current_server = first_server;
+    start_new_set(st);
+}
 
-    int server = st.current_server;
-    int returner = (server==0?1:0);
+// threshold[s]: server s wins the point when the top 53 bits of a draw fall below it.
+static void sim_play_match(MatchState& st, SimRng& rng, const uint64_t threshold[2], SimTotals& t) {
+    sim_reset(st, (int)(rng.next() & 1));
+    int points = 0;
+    while (!match_is_over_now(st)) {
+        // The match TB10 is started by whoever is due to serve next
+        if (st.in_match_tiebreak10 && st.tb_points_p1==0 && st.tb_points_p2==0)
+            st.tb_start_server = st.current_server;
+        if (st.in_set_tiebreak || st.in_match_tiebreak10)
+            st.current_server = tiebreak_server(st);
+        int server = st.current_server;
+        int winner = ((rng.next() >> 11) < threshold[server]) ? server : 1 - server;
+        if (st.in_set_tiebreak) give_point_tiebreak(st, winner, true);
+        else if (st.in_match_tiebreak10) give_point_tiebreak(st, winner, false);
+        else give_point_regular(st, winner);
+        points++;
+    }
+    t.matches++;
+    if (st.sets_won_p1 > st.sets_won_p2) t.p1_wins++;
+    if (st.sets_won_p1 == 0 || st.sets_won_p2 == 0) t.straight_sets++;
+    for (const auto& s : st.sets) if (s.set_tiebreak_played) t.tiebreaks++;
+    t.points += points;
+    t.final_sets[min(st.sets_won_p1, 3)][min(st.sets_won_p2, 3)]++;
+    t.length_hist[min(points, SIM_MAX_POINTS)]++;
+}
 
-    // ---- Serve/event menus ----
-    while (true) {
-        print_scoreboard(st);
-        print_serve_menu();
-        cout << "Choose: ";
-        int c; cin>>c;
-
-        if (c==9) {
-            cout << "\nAdmin: 1) Stats  2) Undo last point  3) End match  4) Back\n";
-            int a; cin>>a;
-            if (a==1) {
-                bool back=false;
-                while(!back){
-                    print_stats_menu();
-                    int sm; cin>>sm;
-                    if (sm==1) show_match_totals(st);
-                    else if (sm==2) show_by_set(st);
-                    else if (sm==3) show_point_by_point(st);
-                    else back=true;
+static int length_percentile(const SimTotals& t, double q) {
+    long long want = (long long)(q * t.matches), seen = 0;
+    for (int i=0;i<=SIM_MAX_POINTS;i++) {
+        seen += t.length_hist[i];
+        if (seen > want) return i;
+    }
+    return SIM_MAX_POINTS;
+}
+
+static Fixed percent_of(long long num, long long den) {
+    return Fixed{den > 0 ? 100.0 * num / den : 0.0, 1};
+}
+
+static int run_simulation(const SimConfig& cfg) {
+    FormatConfig f = get_format_by_choice(cfg.format_choice);
+    const int sets_to_win = 2;
+    unsigned n = cfg.threads > 0 ? (unsigned)cfg.threads : thread::hardware_concurrency();
+    if (n == 0) n = 1;
+    uint64_t threshold[2];
+    for (int s=0;s<2;s++) threshold[s] = (uint64_t)(cfg.serve_rate[s] * 9007199254740992.0);   // 2^53
+
+    atomic<long long> next_match(0);
+    vector<SimTotals> per_thread(n);
+    auto t0 = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned w=0;w<n;w++) {
+        workers.emplace_back([&, w] {
+            MatchState st;
+            st.format = f;
+            st.sets_to_win = sets_to_win;
+            SimTotals& t = per_thread[w];
+            for (;;) {
+                long long begin = next_match.fetch_add(SIM_BATCH);
+                if (begin >= cfg.matches) break;
+                long long end = min(begin + SIM_BATCH, cfg.matches);
+                for (long long m=begin;m<end;m++) {
+                    SimRng rng(cfg.seed, (uint64_t)m);
+                    sim_play_match(st, rng, threshold, t);
                 }
-            } else if (a==2) {
-                pop_history(st); // remove our pre-push
-                if (!pop_history(st)) cout<<"Nothing to undo.\n";
-                else cout<<"Undid last point.\n";
-                return;
-            } else if (a==3) {
-                pop_history(st);
-                return;
             }
-            continue;
+        });
+    }
+    for (auto& w : workers) w.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    SimTotals total;
+    for (const auto& t : per_thread) total.add(t);
+
+    // The Markov model's answer for the same rates, averaged over the coin toss
+    WinProbModel model(f, sets_to_win, cfg.serve_rate[0], cfg.serve_rate[1]);
+    MatchState start;
+    start.format = f;
+    start.sets_to_win = sets_to_win;
+    start_new_set(start);
+    double exact = 0;
+    for (int s=0;s<2;s++) { start.current_server = s; exact += 0.5 * model.player1_wins(start); }
+
+    OutBuf& b = scratch_buffer();
+    b << "Simulated " << total.matches << " matches (format " << cfg.format_choice
+      << ", P1 serve " << Fixed{100 * cfg.serve_rate[0], 1} << "%, P2 serve " << Fixed{100 * cfg.serve_rate[1], 1}
+      << "%, seed " << cfg.seed << ") on " << n << " thread" << (n==1 ? "" : "s") << "\n";
+    b << "  Time: " << Fixed{secs, 3} << " s   Throughput: "
+      << (long long)(secs > 0 ? total.matches / secs : 0) << " matches/s\n";
+    b << "  P1 wins:              " << percent_of(total.p1_wins, total.matches)
+      << "%   (model: " << Fixed{100 * exact, 1} << "%)\n";
+    b << "  Straight sets:        " << percent_of(total.straight_sets, total.matches) << "%\n";
+    b << "  Final sets:          ";
+    for (int i=0;i<4;i++) for (int j=0;j<4;j++) {
+        if (!total.final_sets[i][j]) continue;
+        b << ' ' << i << '-' << j << ' ' << percent_of(total.final_sets[i][j], total.matches) << '%';
+    }
+    b << "\n";
+    b << "  Tiebreaks per match:  " << Fixed{total.matches ? (double)total.tiebreaks / total.matches : 0.0, 3} << "\n";
+    b << "  Points per match:     mean " << Fixed{total.matches ? (double)total.points / total.matches : 0.0, 1}
+      << "  p10 " << length_percentile(total, 0.10) << "  p50 " << length_percentile(total, 0.50)
+      << "  p90 " << length_percentile(total, 0.90) << "\n";
+    write_stdout(b);
+    cout.flush();
+    return 0;
+}
+
+// =============== Match export ===============
+
+// Plays generated match `idx` to the end through apply_point_event, undoing
+// points at cfg.undo_rate (at most GEN_MAX_UNDOS times). Returns the
+// number of undos.
+static long long play_generated_match(MatchState& st, const GenConfig& cfg, const FormatConfig& f,
+                                      uint64_t seed, uint64_t idx) {
+    MatchGenerator gen(cfg, seed, idx);
+    char num[FORMAT_BUF];
+    st.player1_name = "Gen A";
+    st.player2_name = "Gen B";
+    st.location = "Synthetic #" + string(num, format_int(num, (long long)idx));
+    st.format = f;
+    st.sets_to_win = 2;
+    st.current_server = (gen.uniform() < 0.5) ? 0 : 1;
+    start_new_set(st);
+
+    long long undos = 0;
+    history_stack.clear();
+    while (!match_is_over_now(st)) {
+        // The match TB10 is started by whoever is due to serve next
+        if (st.in_match_tiebreak10 && st.tb_points_p1==0 && st.tb_points_p2==0)
+            st.tb_start_server = st.current_server;
+        apply_point_event(st, gen.next(st));
+        if (cfg.undo_rate > 0 && undos < GEN_MAX_UNDOS && gen.uniform() < cfg.undo_rate && pop_history(st)) undos++;
+    }
+    history_stack.clear();
+    return undos;
+}
+
+// Generates `count` matches and writes all five exports of each into
+// out_dir, a chunk at a time through the bulk writer. Returns the number of
+// files that failed, or -1 if out_dir cannot be created.
+static int generate_matches(const GenConfig& cfg, int format_choice, uint64_t seed,
+                            long long count, const string& out_dir) {
+    if (!make_output_dir(out_dir)) return -1;
+    FormatConfig f = get_format_by_choice(format_choice);
+    const long long chunk = BULK_QUEUE_DEPTH / EXPORT_FORMAT_COUNT;
+    long long points = 0, undos = 0, longest = 0;
+    size_t written = 0;
+    int failed = 0;
+    double play_secs = 0;
+    auto t0 = chrono::steady_clock::now();
+
+    for (long long start = 0; start < count; start += chunk) {
+        size_t n = (size_t)min(chunk, count - start);
+        vector<MatchState> matches(n);
+        auto p0 = chrono::steady_clock::now();
+        for (size_t k = 0; k < n; k++) {
+            undos += play_generated_match(matches[k], cfg, f, seed, (uint64_t)(start + k));
+            points += (long long)matches[k].log_entries.size();
+            longest = max(longest, (long long)matches[k].log_entries.size());
         }
+        play_secs += chrono::duration<double>(chrono::steady_clock::now() - p0).count();
 
-        if (c==1) { // 1st in
-            st.current_point_serve = SERVE_FIRST;
-            add_serve_attempt(st, server, SERVE_FIRST, true);
-            entry.event_chain += "1st in; ";
-            break;
-        } else if (c==2) { // 1st fault -> second
-            add_serve_attempt(st, server, SERVE_FIRST, false);
-            entry.event_chain += "1st fault -> ";
-            cout<<"Second serve: 1) in  2) double fault\n";
-            int s2; cin>>s2;
-            if (s2==1) {
-                st.current_point_serve = SERVE_SECOND;
-                add_serve_attempt(st, server, SERVE_SECOND, true);
-                entry.event_chain += "2nd in; ";
-                break;
+        vector<BulkFile> files(n * EXPORT_FORMAT_COUNT);
+        for (size_t k = 0; k < n; k++) {
+            export_pool().submit([&, k]{
+                AllocSiteScope site(SITE_EXPORT);
+                TraceSpan t("render generated match");
+                char num[FORMAT_BUF];
+                int len = format_int(num, start + (long long)k);
+                string stem = "gen_" + string(len < 6 ? 6 - len : 0, '0') + string(num, len);
+                for (int e = 0; e < EXPORT_FORMAT_COUNT; e++) {
+                    OutBuf out;
+                    EXPORT_FORMATS[e].render(out, matches[k]);
+                    BulkFile& bf = files[k * EXPORT_FORMAT_COUNT + e];
+                    bf.path = out_dir + "/" + stem + EXPORT_FORMATS[e].suffix;
+                    bf.data = std::move(out.data);
+                }
+            });
+        }
+        export_pool().wait_idle();
+        write_files_bulk(files);
+        for (const auto& bf : files) {
+            if (bf.ok) written++;
+            else { cerr << "Could not write " << bf.path << "\n"; failed++; }
+        }
+    }
+
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    OutBuf& b = scratch_buffer();
+    b << "Generated " << count << " matches (" << points << " points, longest " << longest
+      << ", " << undos << " undos) and wrote " << (long long)written << " files in " << Fixed{secs, 3} << " s\n";
+    b << "  Scoring: " << (long long)(play_secs > 0 ? points / play_secs : 0) << " points/s\n";
+    write_stdout(b);
+    cout.flush();
+    return failed;
+}
+
+// =============== Court server ===============
+// --server PATH hosts any number of courts in one process. Scorers connect
+// to the Unix socket at PATH and send one command per line; every command
+// gets exactly one reply line, "ok ..." or "err ...". A connection first
+// picks its court, and any number of connections may share one court.
+//
+//   court ID                      select (or create) court ID
+//   match F S P1|P2[|LOCATION]    new match: format 1-3, first server 1 or 2
+//   point KEYS                    one point, as the menu keys typed in order
+//   key KEYS                      some of a point's keys; the rest can follow later
+//   undo / score / save / quit
+//
+// With --players, a court's finished match goes into the player database
+// when the court starts another match, saves, or the server stops; undo is
+// refused after that.
+//
+// KEYS are the serve, second-serve, return, rally, net and net-player
+// answers from the interactive menus, e.g. "point 1 4 2 1" (1st in, return
+// in, returner winner, no net) or "point 5" (ace). They drive the same
+// PointEntry as the terminal, so "key" can take them one at a time, as a
+// scorer presses them; "ok next STAGE" says which question is open. One epoll loop on the
+// main thread serves every court, so scoring stays single threaded as in
+// live entry; exports still go to the worker pool.
+#ifdef HAVE_EPOLL
+
+static const size_t COURT_MAX_LINE = 4096;          // longer lines drop the connection
+static const size_t COURT_MAX_PENDING = 1u << 20;   // unread replies before we give up on a client
+static const size_t COURT_UNDO_DEPTH = 64;          // undo records always kept per court
+static const size_t COURT_MAX_ID = 32;
+
+struct Court {
+    string id;
+    MatchState st;
+    vector<UndoRecord> history;   // this court's history_stack
+    PointEntry entry;             // point being entered with "key"
+    unique_ptr<ShmScoreboardWriter> shm;
+    bool started = false;
+    bool recorded = false;        // folded into the player database
+};
+
+struct CourtConn {
+    int fd = -1;
+    string in, out;
+    Court* court = nullptr;
+    bool closing = false;
+};
+
+// Feeds menu keys (one digit each, spaces optional) into entry, stopping at
+// the first one the menus would reject.
+static const char* feed_point_keys(PointEntry& entry, const char* s) {
+    for (; *s; s++) {
+        if (*s == ' ') continue;
+        if (*s < '1' || *s > '9') return "keys are digits 1-9";
+        if (entry.stage() == ENTRY_DONE) return "too many keys";
+        EntryResult r = entry.feed(*s - '0');
+        if (r == ENTRY_INVALID || r == ENTRY_ADMIN) return "invalid key";
+    }
+    return nullptr;
+}
+
+// Runs fn with the court's own undo stack in place of the global one. The
+// oldest records are trimmed in bulk, so the stack holds between
+// COURT_UNDO_DEPTH and twice that.
+template <class F>
+static void with_court_history(Court& c, F fn) {
+    history_stack.swap(c.history);
+    fn();
+    if (history_stack.size() > 2 * COURT_UNDO_DEPTH)
+        history_stack.erase(history_stack.begin(), history_stack.end() - COURT_UNDO_DEPTH);
+    history_stack.swap(c.history);
+}
+
+static void court_reply_score(OutBuf& b, const Court& c) {
+    b << "ok {\"court\":\"" << c.id << "\",\"points\":" << (long long)c.st.log_entries.size()
+      << ",\"over\":" << (match_is_over_now(c.st) ? "true" : "false") << ',';
+    live_render_scoreline(b, c.st, c.st.sets[c.st.current_set_index]);
+    b << "}\n";
+}
+
+static string court_shm_prefix;   // --shm with --server: each court publishes at PREFIX-ID
+static string court_players_path; // --players: finished matches go into this database
+static Surface court_surface = SURFACE_HARD;
+
+// Scoring commands end here so the court's shared-memory board follows.
+static void court_reply_published(OutBuf& b, Court& c) {
+    if (c.shm) c.shm->publish(c.st);
+    court_reply_score(b, c);
+}
+
+// A finished match goes into the player database once the court is done
+// with it: a new match, "save", or server shutdown. After that "undo" is
+// refused, so the database never holds a result the court has taken back.
+// The write runs on the export pool; a slow or locked database file must
+// not hold up the other courts.
+static void court_record_match(Court& c) {
+    if (c.recorded || court_players_path.empty() || !c.started || !match_is_over_now(c.st)) return;
+    c.recorded = true;
+    auto snapshot = make_shared<const MatchState>(c.st);
+    string path = court_players_path;
+    Surface surface = court_surface;
+    export_pool().submit([snapshot, path, surface]{ record_finished_match(path, *snapshot, surface); });
+}
+
+static bool valid_court_id(const string& id) {
+    if (id.empty() || id.size() > COURT_MAX_ID) return false;
+    for (char ch : id)
+        if (!isalnum((unsigned char)ch) && ch != '-' && ch != '_') return false;
+    return true;
+}
+
+static void court_command(unordered_map<string, unique_ptr<Court>>& courts, CourtConn& conn, const string& line) {
+    OutBuf b;
+    size_t sp = line.find(' ');
+    string cmd = line.substr(0, sp);
+    string arg = (sp == string::npos) ? "" : line.substr(sp + 1);
+
+    if (cmd == "court") {
+        if (!valid_court_id(arg)) b << "err court ID is 1-32 letters, digits, '-' or '_'\n";
+        else {
+            unique_ptr<Court>& c = courts[arg];
+            if (!c) {
+                c.reset(new Court);
+                c->id = arg;
+                if (!court_shm_prefix.empty()) {
+                    string name = court_shm_prefix + "-" + arg;
+                    c->shm.reset(new ShmScoreboardWriter);
+                    if (!c->shm->open(name)) {
+                        // A court that cannot publish its board is not created at all
+                        b << "err cannot open scoreboard " << name << ": " << strerror(errno) << '\n';
+                        courts.erase(arg);
+                    }
+                }
+            }
+            if (b.data.empty()) {
+                conn.court = c.get();
+                b << "ok court " << arg << '\n';
+            }
+        }
+    } else if (cmd == "quit") {
+        b << "ok bye\n";
+        conn.closing = true;
+    } else if (!conn.court) {
+        b << "err no court selected (send: court ID)\n";
+    } else if (cmd == "match") {
+        int fmt = 0, first = 0, used = 0;
+        if (sscanf(arg.c_str(), "%d %d %n", &fmt, &first, &used) < 2 || fmt < 1 || fmt > 3 || first < 1 || first > 2) {
+            b << "err usage: match F S P1|P2[|LOCATION]\n";
+        } else {
+            string names = arg.substr(used);
+            size_t bar = names.find('|');
+            size_t bar2 = (bar == string::npos) ? bar : names.find('|', bar + 1);
+            if (bar == string::npos || bar == 0 || bar + 1 == min(bar2, names.size())) {
+                b << "err usage: match F S P1|P2[|LOCATION]\n";
             } else {
-                st.current_point_serve = SERVE_SECOND;
-                add_serve_attempt(st, server, SERVE_SECOND, false);
-                add_double_fault(st, server);
-                entry.event_chain += "double fault.";
-                // Point to returner
-                PlayerStats& mw = (returner==0? st.match_stats_p1 : st.match_stats_p2);
-                PlayerStats& ml = (server==0? st.match_stats_p1 : st.match_stats_p2);
-                add_stats_point_ownership(mw, ml);
-                maybe_count_break_point(st, was_break_point, /*returner won*/true);
-                entry.serve_type = SERVE_SECOND; entry.point_winner = returner;
-                st.log_entries.push_back(entry);
-                if (st.in_set_tiebreak) give_point_tiebreak(st, returner, true);
-                else if (st.in_match_tiebreak10) give_point_tiebreak(st, returner, false);
-                else give_point_regular(st, returner);
-                return;
+                Court& c = *conn.court;
+                court_record_match(c);
+                c.st = MatchState();
+                c.history.clear();
+                c.entry = PointEntry();
+                c.recorded = false;
+                c.st.player1_name = names.substr(0, bar);
+                c.st.player2_name = names.substr(bar + 1, bar2 == string::npos ? string::npos : bar2 - bar - 1);
+                c.st.location = (bar2 == string::npos) ? "Court " + c.id : names.substr(bar2 + 1);
+                c.st.format = get_format_by_choice(fmt);
+                c.st.current_server = first - 1;
+                start_new_set(c.st);
+                c.started = true;
+                court_reply_published(b, c);
             }
-        } else if (c==3) { // 2nd in
-            st.current_point_serve = SERVE_SECOND;
-            add_serve_attempt(st, server, SERVE_SECOND, true);
-            entry.event_chain += "2nd in; ";
-            break;
-        } else if (c==4) { // DF
-            st.current_point_serve = SERVE_SECOND;
-            add_serve_attempt(st, server, SERVE_SECOND, false);
-            add_double_fault(st, server);
-            entry.event_chain += "double fault.";
-            PlayerStats& mw = (returner==0? st.match_stats_p1 : st.match_stats_p2);
-            PlayerStats& ml = (server==0? st.match_stats_p1 : st.match_stats_p2);
-            add_stats_point_ownership(mw, ml);
-            maybe_count_break_point(st, was_break_point, true);
-            entry.serve_type=SERVE_SECOND; entry.point_winner=returner;
-            st.log_entries.push_back(entry);
-            if (st.in_set_tiebreak) give_point_tiebreak(st, returner, true);
-            else if (st.in_match_tiebreak10) give_point_tiebreak(st, returner, false);
-            else give_point_regular(st, returner);
-            return;
-        } else if (c==5) { // Ace 1st
-            st.current_point_serve = SERVE_FIRST;
-            add_serve_attempt(st, server, SERVE_FIRST, true);
-            add_ace(st, server, SERVE_FIRST);
-            add_server_point_won(st, server, SERVE_FIRST);
-            entry.event_chain += "Ace (1st).";
-            PlayerStats& mw = (server==0? st.match_stats_p1 : st.match_stats_p2);
-            PlayerStats& ml = (returner==0? st.match_stats_p1 : st.match_stats_p2);
-            add_stats_point_ownership(mw, ml);
-            maybe_count_break_point(st, was_break_point, false);
-            entry.serve_type=SERVE_FIRST; entry.point_winner=server;
-            st.log_entries.push_back(entry);
-            if (st.in_set_tiebreak) give_point_tiebreak(st, server, true);
-            else if (st.in_match_tiebreak10) give_point_tiebreak(st, server, false);
-            else give_point_regular(st, server);
-            return;
-        } else if (c==6) { // Ace 2nd
-            st.current_point_serve = SERVE_SECOND;
-            add_serve_attempt(st, server, SERVE_SECOND, true);
-            add_ace(st, server, SERVE_SECOND);
-            add_server_point_won(st, server, SERVE_SECOND);
-            entry.event_chain += "Ace (2nd).";
-            PlayerStats& mw = (server==0? st.match_stats_p1 : st.match_stats_p2);
-            PlayerStats& ml = (returner==0? st.match_stats_p1 : st.match_stats_p2);
-            add_stats_point_ownership(mw, ml);
-            maybe_count_break_point(st, was_break_point, false);
-            entry.serve_type=SERVE_SECOND; entry.point_winner=server;
-            st.log_entries.push_back(entry);
-            if (st.in_set_tiebreak) give_point_tiebreak(st, server, true);
-            else if (st.in_match_tiebreak10) give_point_tiebreak(st, server, false);
-            else give_point_regular(st, server);
-            return;
-        } else if (c==7) { // SW 1st
-            st.current_point_serve = SERVE_FIRST;
-            add_serve_attempt(st, server, SERVE_FIRST, true);
-            add_service_winner(st, server, SERVE_FIRST);
-            add_server_point_won(st, server, SERVE_FIRST);
-            entry.event_chain += "Service winner (1st).";
-            PlayerStats& mw = (server==0? st.match_stats_p1 : st.match_stats_p2);
-            PlayerStats& ml = (returner==0? st.match_stats_p1 : st.match_stats_p2);
-            add_stats_point_ownership(mw, ml);
-            maybe_count_break_point(st, was_break_point, false);
-            entry.serve_type=SERVE_FIRST; entry.point_winner=server;
-            st.log_entries.push_back(entry);
-            if (st.in_set_tiebreak) give_point_tiebreak(st, server, true);
-            else if (st.in_match_tiebreak10) give_point_tiebreak(st, server, false);
-            else give_point_regular(st, server);
-            return;
-        } else if (c==8) { // SW 2nd
-            st.current_point_serve = SERVE_SECOND;
-            add_serve_attempt(st, server, SERVE_SECOND, true);
-            add_service_winner(st, server, SERVE_SECOND);
-            add_server_point_won(st, server, SERVE_SECOND);
-            entry.event_chain += "Service winner (2nd).";
-            PlayerStats& mw = (server==0? st.match_stats_p1 : st.match_stats_p2);
-            PlayerStats& ml = (returner==0? st.match_stats_p1 : st.match_stats_p2);
-            add_stats_point_ownership(mw, ml);
-            maybe_count_break_point(st, was_break_point, false);
-            entry.serve_type=SERVE_SECOND; entry.point_winner=server;
-            st.log_entries.push_back(entry);
-            if (st.in_set_tiebreak) give_point_tiebreak(st, server, true);
-            else if (st.in_match_tiebreak10) give_point_tiebreak(st, server, false);
-            else give_point_regular(st, server);
-            return;
+        }
+    } else if (!conn.court->started) {
+        b << "err no match on this court (send: match ...)\n";
+    } else if (cmd == "point" || cmd == "key") {
+        Court& c = *conn.court;
+        PointEntry whole;
+        PointEntry& entry = (cmd == "key") ? c.entry : whole;
+        const char* err = match_is_over_now(c.st) ? "match is over" : feed_point_keys(entry, arg.c_str());
+        if (!err && cmd == "point" && entry.stage() != ENTRY_DONE) err = "point is incomplete";
+        if (err) {
+            b << "err " << err;
+            if (cmd == "key") b << " (next: " << ENTRY_STAGE_NAMES[entry.stage()] << ')';
+            b << '\n';
+        } else if (entry.stage() != ENTRY_DONE) {
+            b << "ok next " << ENTRY_STAGE_NAMES[entry.stage()] << '\n';
         } else {
-            cout<<"Invalid option.\n";
+            with_court_history(c, [&]{
+                // The match TB10 is started by whoever is due to serve next
+                if (c.st.in_match_tiebreak10 && c.st.tb_points_p1==0 && c.st.tb_points_p2==0)
+                    c.st.tb_start_server = c.st.current_server;
+                apply_point_event(c.st, entry.event());
+            });
+            c.entry = PointEntry();
+            court_reply_published(b, c);
         }
+    } else if (cmd == "undo" && conn.court->recorded) {
+        b << "err match is already in the player database\n";
+    } else if (cmd == "undo") {
+        conn.court->entry = PointEntry();
+        bool undone = false;
+        with_court_history(*conn.court, [&]{ undone = pop_history(conn.court->st); });
+        if (undone) court_reply_published(b, *conn.court);
+        else b << "err nothing to undo\n";
+    } else if (cmd == "score") {
+        court_reply_score(b, *conn.court);
+    } else if (cmd == "save") {
+        save_match_files(conn.court->st);
+        court_record_match(*conn.court);
+        b << "ok saving\n";
+    } else {
+        b << "err unknown command '" << cmd << "'\n";
     }
+    conn.out.append(b.data);
+}
 
-    // If serve is in, proceed to return/rally
-    while (true) {
-        print_scoreboard(st);
-        print_return_menu();
-        cout<<"Choose: ";
-        int r; cin>>r;
-        if (r==1) {
-            add_return_outcome(st, returner, "winner");
-            add_return_points_won(st, returner, st.current_point_serve);
-            entry.event_chain += "Return winner.";
-            PlayerStats& mw = (returner==0? st.match_stats_p1 : st.match_stats_p2);
-            PlayerStats& ml = (server==0? st.match_stats_p1 : st.match_stats_p2);
-            add_stats_point_ownership(mw, ml);
-            maybe_count_break_point(st, was_break_point, true);
-            entry.serve_type=st.current_point_serve; entry.point_winner=returner;
-            st.log_entries.push_back(entry);
-            if (st.in_set_tiebreak) give_point_tiebreak(st, returner, true);
-            else if (st.in_match_tiebreak10) give_point_tiebreak(st, returner, false);
-            else give_point_regular(st, returner);
-            return;
-        } else if (r==2) {
-            add_return_outcome(st, returner, "ue");
-            add_server_point_won(st, server, st.current_point_serve);
-            entry.event_chain += "Return UE.";
-            PlayerStats& mw = (server==0? st.match_stats_p1 : st.match_stats_p2);
-            PlayerStats& ml = (returner==0? st.match_stats_p1 : st.match_stats_p2);
-            add_stats_point_ownership(mw, ml);
-            maybe_count_break_point(st, was_break_point, false);
-            entry.serve_type=st.current_point_serve; entry.point_winner=server;
-            st.log_entries.push_back(entry);
-            if (st.in_set_tiebreak) give_point_tiebreak(st, server, true);
-            else if (st.in_match_tiebreak10) give_point_tiebreak(st, server, false);
-            else give_point_regular(st, server);
-            return;
-        } else if (r==3) {
-            add_return_outcome(st, returner, "fe");
-            add_rally_outcome(st, server, "fedrawn");
-            add_server_point_won(st, server, st.current_point_serve);
-            entry.event_chain += "Return FE (drawn by server).";
-            PlayerStats& mw = (server==0? st.match_stats_p1 : st.match_stats_p2);
-            PlayerStats& ml = (returner==0? st.match_stats_p1 : st.match_stats_p2);
-            add_stats_point_ownership(mw, ml);
-            maybe_count_break_point(st, was_break_point, false);
-            entry.serve_type=st.current_point_serve; entry.point_winner=server;
-            st.log_entries.push_back(entry);
-            if (st.in_set_tiebreak) give_point_tiebreak(st, server, true);
-            else if (st.in_match_tiebreak10) give_point_tiebreak(st, server, false);
-            else give_point_regular(st, server);
-            return;
-        } else if (r==4) {
-            entry.event_chain += "Return in; ";
-            break;
-        } else {
-            cout<<"Invalid option.\n";
+// Sends queued reply lines until the socket is full; false if the scorer
+// has hung up.
+static bool court_flush(CourtConn& conn) {
+    while (!conn.out.empty()) {
+        iovec iov{(char*)conn.out.data(), conn.out.size()};
+        ssize_t n = send_some(conn.fd, &iov, 1);
+        if (n < 0) return false;
+        if (n == 0) break;
+        conn.out.erase(0, (size_t)n);
+    }
+    return true;
+}
+
+// Reads everything available and runs each complete line; false once the
+// connection should be closed.
+static bool court_read(unordered_map<string, unique_ptr<Court>>& courts, CourtConn& conn) {
+    char buf[4096];
+    for (;;) {
+        ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+        if (n == 0) return false;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
         }
+        conn.in.append(buf, (size_t)n);
+    }
+    size_t start = 0, nl;
+    while (!conn.closing && (nl = conn.in.find('\n', start)) != string::npos) {
+        size_t end = (nl > start && conn.in[nl-1] == '\r') ? nl - 1 : nl;
+        court_command(courts, conn, conn.in.substr(start, end - start));
+        start = nl + 1;
+    }
+    conn.in.erase(0, start);
+    return conn.in.size() <= COURT_MAX_LINE;
+}
+
+static int run_court_server(const string& path, const string& shm_prefix, const string& players_path, Surface surface) {
+    court_shm_prefix = shm_prefix;
+    court_players_path = players_path;
+    court_surface = surface;
+    int lfd = unix_listen(path, 128);
+    if (lfd < 0) {
+        cerr << "Cannot listen on " << path << ": " << strerror(errno) << "\n";
+        return 1;
     }
+    // SIGINT/SIGTERM arrive as readable events so the loop can shut down cleanly
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    epoll_watch(ep, lfd, EPOLLIN);
+    epoll_watch(ep, sfd, EPOLLIN);
+    cout << "Serving courts on " << path << "\n";
+    cout.flush();
 
-    // Rally phase
-    while (true) {
-        print_scoreboard(st);
-        print_rally_menu();
-        cout<<"Choose: ";
-        int rv; cin>>rv;
-
-        cout<<"Mark net point? 1) No  2) Yes\n";
-        int netChoice; cin>>netChoice;
-        bool net_mark=(netChoice==2);
-        int net_player=-1; bool net_won=false;
-        if (net_mark) {
-            cout<<"Who was at net? 1) "<<st.player1_name<<"  2) "<<st.player2_name<<"\n";
-            int np; cin>>np; net_player=(np==1?0:1);
-        }
-
-        int point_winner=-1; string desc;
-        if (rv==1){ add_rally_outcome(st, server, "winner"); add_server_point_won(st, server, st.current_point_serve); desc="Rally: server winner."; point_winner=server; }
-        else if (rv==2){ add_rally_outcome(st, returner, "winner"); add_return_points_won(st, returner, st.current_point_serve); desc="Rally: returner winner."; point_winner=returner; }
-        else if (rv==3){ add_rally_outcome(st, server, "ue"); add_return_points_won(st, returner, st.current_point_serve); desc="Rally: server UE."; point_winner=returner; }
-        else if (rv==4){ add_rally_outcome(st, returner, "ue"); add_server_point_won(st, server, st.current_point_serve); desc="Rally: returner UE."; point_winner=server; }
-        else if (rv==5){ add_rally_outcome(st, returner, "fedrawn"); add_return_points_won(st, returner, st.current_point_serve); desc="Rally: server FE (drawn by returner)."; point_winner=returner; }
-        else if (rv==6){ add_rally_outcome(st, server, "fedrawn"); add_server_point_won(st, server, st.current_point_serve); desc="Rally: returner FE (drawn by server)."; point_winner=server; }
-        else { cout<<"Invalid option.\n"; continue; }
-
-        PlayerStats& mw = (point_winner==0? st.match_stats_p1 : st.match_stats_p2);
-        PlayerStats& ml = (point_winner==0? st.match_stats_p2 : st.match_stats_p1);
-        add_stats_point_ownership(mw, ml);
-
-        if (net_mark) {
-            if (net_player==0){ add_stats_net(st.match_stats_p1, point_winner==0); add_stats_net(st.per_set_stats_p1[st.current_set_index], point_winner==0); }
-            else { add_stats_net(st.match_stats_p2, point_winner==1); add_stats_net(st.per_set_stats_p2[st.current_set_index], point_winner==1); }
-        }
-
-        bool returner_won=(point_winner==returner);
-        maybe_count_break_point(st, was_break_point, returner_won);
-
-        entry.event_chain += desc;
-        entry.serve_type = st.current_point_serve;
-        entry.point_winner = point_winner;
-        st.log_entries.push_back(entry);
-
-        if (st.in_set_tiebreak) give_point_tiebreak(st, point_winner, true);
-        else if (st.in_match_tiebreak10) give_point_tiebreak(st, point_winner, false);
-        else give_point_regular(st, point_winner);
-        return;
+    unordered_map<string, unique_ptr<Court>> courts;
+    ConnTable<CourtConn> conns(ep);
+
+    bool running = true;
+    epoll_event events[64];
+    while (running) {
+        int n = epoll_wait(ep, events, 64, -1);
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == sfd) { running = false; continue; }
+            if (fd == lfd) {
+                conns.accept_all(lfd, [](CourtConn&){});
+                continue;
+            }
+            CourtConn* conn = conns.find(fd);
+            if (!conn) continue;
+            bool keep = true;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) keep = court_read(courts, *conn);
+            keep = court_flush(*conn) && keep && conn->out.size() <= COURT_MAX_PENDING;
+            if (!keep || (conn->closing && conn->out.empty())) { conns.drop(fd); continue; }
+            conns.want_output(*conn, !conn->out.empty());
+        }
+        report_finished_exports();
     }
+
+    conns.drop_all();
+    for (auto& kv : courts) court_record_match(*kv.second);
+    close(ep);
+    close(sfd);
+    close(lfd);
+    unlink(path.c_str());
+    cout << "Stopped serving " << courts.size() << " courts\n";
+    return 0;
 }
 
+#endif // HAVE_EPOLL
+
 // =============== Main ===============
 
-int main(){
+static void print_usage(const char* prog) {
+    cout << "Usage: " << prog << " [options]\n";
+    cout << "  --live PATH     append one NDJSON line per point to PATH ('-' = stdout)\n";
+    cout << "  --live-fd N     same, to an already open file descriptor\n";
+    cout << "  --plain         print the scoreboard inline instead of pinning it to the top\n";
+    cout << "  --keys          single-keystroke entry: menu choices take effect without Enter\n";
+    cout << "  --timings       print per-phase latency percentiles at exit\n";
+    cout << "  --trace FILE    write Chrome/Perfetto trace events for each phase and export to FILE\n";
+    cout << "  --reexport DIR FILE.json...\n";
+    cout << "                  regenerate all exports for saved matches into DIR and exit\n";
+    cout << "  --simulate N    play N random matches and print outcome distributions, then exit\n";
+    cout << "      --p1 P, --p2 P   serve-point win rate of each player (default 0.64, 0.62)\n";
+    cout << "      --format F       match format 1-3 as in the format menu (default 1)\n";
+    cout << "      --threads T      worker threads (default: one per core)\n";
+    cout << "      --seed S         random seed; same seed, same results (default 1)\n";
+    cout << "  --generate N DIR  play N synthetic matches through the engine and export them all to DIR\n";
+    cout << "      --p1, --p2, --format, --seed as for --simulate\n";
+    cout << "      --undo-rate U    undo each point with probability U, 0 <= U < 1 (default 0)\n";
+    cout << "      --pathological   force a 100+ point deuce game and a 30-28 tiebreak into every match\n";
+    cout << "  --server PATH   host many courts in one process; scorers connect to the Unix socket PATH\n";
+    cout << "  --shm NAME      publish the live score in shared memory NAME (with --server: NAME-COURT)\n";
+    cout << "  --watch NAME    print the score published at NAME whenever it changes\n";
+    cout << "  --http [HOST:]PORT  answer GET /score, /stats and /points with JSON\n";
+    cout << "  --players FILE  fold every finished match into the player database FILE\n";
+    cout << "      --surface S      hard, clay, grass or carpet (otherwise asked at the start)\n";
+    cout << "      --career NAME    print NAME's career, season and surface records, then exit\n";
+    cout << "  --feed PATH     push binary score updates to subscribers on the Unix socket PATH\n";
+    cout << "  --subscribe PATH  print the updates from a --feed socket\n";
+}
+
+int main(int argc, char** argv){
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
 
+    bool pinned_scoreboard = true, single_keys = false, timings_at_exit = false;
+    SimConfig sim;
+    GenConfig gen;
+    long long gen_matches = 0;
+    string gen_dir, server_path, shm_name, players_path, career_name;
+    Surface surface = SURFACE_HARD;
+    bool surface_given = false;
+    string interactive_only;   // an option that only applies to the interactive tracker
+    string reexport_dir;
+    vector<string> reexport_inputs;
+    // What --live, --feed and --http opened is closed (and the socket files
+    // removed) on every way out of main.
+    struct OutputCloser {
+        ~OutputCloser() { http_close(); feed_close(); live_stream_close(); }
+    } close_outputs;
+    for (int i=1;i<argc;i++) {
+        string a = argv[i];
+        if (a=="--plain") {
+            pinned_scoreboard = false;
+        } else if (a=="--keys") {
+            single_keys = true;
+        } else if (a=="--timings") {
+            timings_at_exit = true;
+        } else if (a=="--trace" && i+1<argc) {
+            if (!trace_open(argv[++i])) { cerr<<"Cannot open trace file: "<<argv[i]<<"\n"; return 1; }
+        } else if (a=="--live" && i+1<argc) {
+            if (!live_stream_open(argv[++i])) { cerr<<"Cannot open live stream: "<<argv[i]<<"\n"; return 1; }
+            interactive_only = a;
+        } else if (a=="--reexport" && i+2<argc) {
+            reexport_dir = argv[++i];
+            reexport_inputs.assign(argv + i + 1, argv + argc);
+            break;
+        } else if (a=="--simulate" && i+1<argc) {
+            sim.matches = atoll(argv[++i]);
+            if (sim.matches <= 0) { cerr<<"Bad match count: "<<argv[i]<<"\n"; return 1; }
+        } else if ((a=="--p1" || a=="--p2") && i+1<argc) {
+            double p = strtod(argv[++i], nullptr);
+            if (!(p > 0 && p < 1)) { cerr<<"Serve rate must be between 0 and 1: "<<argv[i]<<"\n"; return 1; }
+            sim.serve_rate[a=="--p1" ? 0 : 1] = p;
+        } else if (a=="--format" && i+1<argc) {
+            sim.format_choice = atoi(argv[++i]);
+            if (sim.format_choice < 1 || sim.format_choice > 3) { cerr<<"Format must be 1, 2 or 3\n"; return 1; }
+        } else if (a=="--threads" && i+1<argc) {
+            sim.threads = atoi(argv[++i]);
+        } else if (a=="--generate" && i+2<argc) {
+            gen_matches = atoll(argv[++i]);
+            gen_dir = argv[++i];
+            if (gen_matches <= 0) { cerr<<"Bad match count: "<<argv[i-1]<<"\n"; return 1; }
+        } else if (a=="--undo-rate" && i+1<argc) {
+            gen.undo_rate = strtod(argv[++i], nullptr);
+            if (!(gen.undo_rate >= 0 && gen.undo_rate < 1)) { cerr<<"Undo rate must be at least 0 and below 1: "<<argv[i]<<"\n"; return 1; }
+        } else if (a=="--pathological") {
+            gen.pathological = true;
+        } else if (a=="--server" && i+1<argc) {
+            server_path = argv[++i];
+        } else if (a=="--shm" && i+1<argc) {
+            shm_name = argv[++i];
+        } else if (a=="--watch" && i+1<argc) {
+            return watch_scoreboard(argv[++i]);
+        } else if (a=="--http" && i+1<argc) {
+            if (!http_open(argv[++i])) { cerr<<"Cannot serve HTTP on "<<argv[i]<<": "<<strerror(errno)<<"\n"; return 1; }
+            interactive_only = a;
+        } else if (a=="--feed" && i+1<argc) {
+            if (!feed_open(argv[++i])) { cerr<<"Cannot open score feed "<<argv[i]<<": "<<strerror(errno)<<"\n"; return 1; }
+            interactive_only = a;
+#ifdef HAVE_EPOLL
+        } else if (a=="--subscribe" && i+1<argc) {
+            return subscribe_feed(argv[++i]);
+#endif
+        } else if (a=="--players" && i+1<argc) {
+            players_path = argv[++i];
+        } else if (a=="--surface" && i+1<argc) {
+            if (!parse_surface(argv[++i], surface)) { cerr<<"Surface must be hard, clay, grass or carpet\n"; return 1; }
+            surface_given = true;
+        } else if (a=="--career" && i+1<argc) {
+            career_name = argv[++i];
+        } else if (a=="--seed" && i+1<argc) {
+            sim.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (a=="--live-fd" && i+1<argc) {
+            const char* arg = argv[++i];
+            char* end = nullptr;
+            errno = 0;
+            long fd = strtol(arg, &end, 10);
+            if (end == arg || *end || errno || fd > INT_MAX) { cerr<<"Bad live stream fd: "<<arg<<"\n"; return 1; }
+            if (!live_stream_attach_fd((int)fd)) { cerr<<"Bad live stream fd: "<<arg<<": "<<strerror(errno)<<"\n"; return 1; }
+            interactive_only = a;
+        } else {
+            print_usage(argv[0]);
+            return (a=="--help" || a=="-h") ? 0 : 1;
+        }
+    }
+
+    const char* batch_mode = !career_name.empty() ? "--career" : sim.matches > 0 ? "--simulate"
+                           : gen_matches > 0 ? "--generate" : !reexport_dir.empty() ? "--reexport"
+                           : !server_path.empty() ? "--server" : nullptr;
+    if (batch_mode && !interactive_only.empty()) {
+        cerr<<interactive_only<<" cannot be combined with "<<batch_mode<<"\n";
+        return 1;
+    }
+    if (!reexport_dir.empty()) return reexport_archive(reexport_inputs, reexport_dir) == 0 ? 0 : 1;
+    if (!career_name.empty()) {
+        if (players_path.empty()) { cerr<<"--career needs --players FILE\n"; return 1; }
+        return show_career(players_path, career_name);
+    }
+    if (sim.matches > 0) return run_simulation(sim);
+    if (gen_matches > 0) {
+        gen.serve_rate[0] = sim.serve_rate[0];
+        gen.serve_rate[1] = sim.serve_rate[1];
+        return generate_matches(gen, sim.format_choice, sim.seed, gen_matches, gen_dir) == 0 ? 0 : 1;
+    }
+    if (!server_path.empty()) {
+#ifdef HAVE_EPOLL
+        int rc = run_court_server(server_path, shm_name, players_path, surface);
+        finish_background_exports();
+        if (timings_at_exit) show_phase_timings();
+        return rc;
+#else
+        cerr << "--server needs Linux (epoll)\n";
+        return 1;
+#endif
+    }
+
+    if (!shm_name.empty() && !shm_board.open(shm_name)) {
+        cerr<<"Cannot create shared-memory scoreboard "<<shm_name<<": "<<strerror(errno)<<"\n";
+        return 1;
+    }
+
+    http_start();
     MatchState st;
 
     cout<<"Enter Player 1 name: ";
@@ -1165,23 +5635,33 @@ int main(){
     getline(cin, st.player2_name); if (st.player2_name.size()==0) getline(cin, st.player2_name);
     cout<<"Enter Location (e.g., Club – Court #): ";
     getline(cin, st.location); if (st.location.size()==0) getline(cin, st.location);
+    if (!players_path.empty() && !surface_given) {
+        cout<<"Surface? 1) Hard  2) Clay  3) Grass  4) Carpet\n";
+        int sc=read_choice();
+        surface = (sc>=1 && sc<=SURFACE_COUNT) ? (Surface)(sc-1) : SURFACE_HARD;
+    }
 
     cout<<"Who serves first? 1) "<<st.player1_name<<"  2) "<<st.player2_name<<"\n";
-    int sfirst=1; cin>>sfirst; st.current_server=(sfirst==2?1:0);
+    int sfirst=read_choice(); st.current_server=(sfirst==2?1:0);
 
     print_format_menu();
-    int fchoice=1; cin>>fchoice;
+    int fchoice=read_choice();
     st.format = get_format_by_choice(fchoice);
 
     // Start set 1
     start_new_set(st);
+    publish_match_update(st);
+    if (pinned_scoreboard) scoreboard_renderer().enable_pinned();
+    if (single_keys && !enter_raw_mode()) cerr<<"--keys needs a terminal on stdin; using line input.\n";
 
     bool done=false;
     while(!done){
+        report_finished_exports();
+
         // If we are about to play a TB10 and have 0-0, ask for starting server once
         if (st.in_match_tiebreak10 && st.tb_points_p1==0 && st.tb_points_p2==0) {
             cout<<"Match TB10. Who serves first? 1) "<<st.player1_name<<"  2) "<<st.player2_name<<"\n";
-            int tbsv; cin>>tbsv; st.tb_start_server=(tbsv==2?1:0);
+            int tbsv=read_choice(); st.tb_start_server=(tbsv==2?1:0);
             st.current_server = st.tb_start_server;
         }
         // If we just entered a set TB (set_tiebreak_played already true), tb_start_server already set to current_server at entry
@@ -1198,10 +5678,15 @@ int main(){
         cout << "  3) Undo last point\n";
         cout << "  4) End match (finish now)\n";
         cout << "Choose: ";
-        int m; cin>>m;
+        int m=read_choice();
 
         if (m==1) {
-            record_point_and_stats(st);
+            {
+                TraceSpan point_span("point");
+                PointAllocReport alloc_report(st);
+                record_point_and_stats(st);
+            }
+            publish_match_update(st);
 
             // If in TB, server will be recomputed next loop. If a set ended or TB10 ended,
             // close_set_and_prepare_next or the TB10 checker already handled transitions.
@@ -1209,6 +5694,8 @@ int main(){
             if (match_is_over_now(st)) {
                 print_scoreboard(st);
                 cout<<"\nMatch finished!\n";
+                if (!players_path.empty() && record_finished_match(players_path, st, surface))
+                    cout<<"Career records updated in "<<players_path<<"\n";
                 cout<<"Final sets won: "<<st.player1_name<<" "<<st.sets_won_p1<<" - "<<st.player2_name<<" "<<st.sets_won_p2<<"\n";
                 cout<<"Final set scores:\n";
                 for (size_t i=0;i<st.sets.size();i++) {
@@ -1218,10 +5705,10 @@ int main(){
                     cout<<"\n";
                 }
                 cout<<"\nShow stats? 1) "<<st.player1_name<<"  2) "<<st.player2_name<<"  3) Both  4) Save results  5) Exit\n";
-                int e; cin>>e;
-                if (e==1) print_single_player_stats(st.match_stats_p1, "== "+st.player1_name+" (Match Totals) ==");
-                else if (e==2) print_single_player_stats(st.match_stats_p2, "== "+st.player2_name+" (Match Totals) ==");
-                else if (e==3) print_side_by_side(st.match_stats_p1, st.match_stats_p2, st.player1_name, st.player2_name);
+                int e=read_choice();
+                if (e==1) show_player_stats(st, -1, 0, "== "+st.player1_name+" (Match Totals) ==");
+                else if (e==2) show_player_stats(st, -1, 1, "== "+st.player2_name+" (Match Totals) ==");
+                else if (e==3) show_both_stats(st, -1);
                 else if (e==4) save_match_files(st);
                 done=true;
             }
@@ -1231,7 +5718,7 @@ int main(){
             while(!back){
                 print_scoreboard(st);
                 print_stats_menu();
-                int sm; cin>>sm;
+                int sm=read_choice();
                 if (sm==1) show_match_totals(st);
                 else if (sm==2) show_by_set(st);
                 else if (sm==3) show_point_by_point(st);
@@ -1241,14 +5728,15 @@ int main(){
         } else if (m==3) {
             if (!pop_history(st)) cout<<"Nothing to undo.\n";
             else cout<<"Undid last point.\n";
+            publish_match_update(st);
 
         } else if (m==4) {
             cout<<"End match now. Show stats? 1) "<<st.player1_name<<"  2) "<<st.player2_name
                 <<"  3) Both  4) Save results  5) Exit\n";
-            int e; cin>>e;
-            if (e==1) print_single_player_stats(st.match_stats_p1, "== "+st.player1_name+" (Totals so far) ==");
-            else if (e==2) print_single_player_stats(st.match_stats_p2, "== "+st.player2_name+" (Totals so far) ==");
-            else if (e==3) print_side_by_side(st.match_stats_p1, st.match_stats_p2, st.player1_name, st.player2_name);
+            int e=read_choice();
+            if (e==1) show_player_stats(st, -1, 0, "== "+st.player1_name+" (Totals so far) ==");
+            else if (e==2) show_player_stats(st, -1, 1, "== "+st.player2_name+" (Totals so far) ==");
+            else if (e==3) show_both_stats(st, -1);
             else if (e==4) save_match_files(st);
             done=true;
         } else {
@@ -1256,6 +5744,18 @@ int main(){
         }
     }
 
+    scoreboard_renderer().shutdown();
+    leave_raw_mode();
+    finish_background_exports();
+    live_stream_close();
+    shm_board.close();
+    feed_close();
+    http_close();
+    trace_close();
+    if (timings_at_exit) show_phase_timings();
+    alloc_report_match();
     cout<<"Goodbye.\n";
     return 0;
 }
+
+#endif // !TENNIS_BENCH
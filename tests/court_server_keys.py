@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+# Out-of-range menu keys sent to --server must be refused at every stage of
+# a point and leave the score alone.
+#
+#   python3 tests/court_server_keys.py ./tennistracker
+import os, shutil, socket, subprocess, sys, tempfile, time
+
+def main():
+    exe = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else "./tennistracker")
+    tmp = tempfile.mkdtemp()
+    path = os.path.join(tmp, "courts.sock")
+    server = subprocess.Popen([exe, "--server", path], cwd=tmp, stdout=subprocess.DEVNULL)
+    try:
+        for _ in range(100):
+            if os.path.exists(path): break
+            time.sleep(0.05)
+        s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        s.connect(path)
+        f = s.makefile("rw")
+
+        def send(line):
+            f.write(line + "\n")
+            f.flush()
+            return f.readline().strip()
+
+        failures = []
+        def expect(line, prefix):
+            reply = send(line)
+            if not reply.startswith(prefix):
+                failures.append("%r -> %r (wanted %s...)" % (line, reply, prefix))
+
+        expect("court t1", "ok court t1")
+        expect("match 1 1 A|B", "ok ")
+        # The last key of each is out of range for its stage: serve, second,
+        # return, rally, net, net player
+        for line in ["point 9", "point 2 7", "point 1 5", "point 1 4 7",
+                     "point 1 4 2 3", "point 1 4 2 2 9"]:
+            expect(line, "err invalid key")
+        # "key" keeps the point open at the stage that refused the key
+        expect("key 2", "ok next second")
+        expect("key 7", "err invalid key (next: second)")
+        expect("key 1", "ok next return")
+        expect("key 5", "err invalid key (next: return)")
+        expect("key 4", "ok next rally")
+        expect("key 7", "err invalid key (next: rally)")
+        expect("key 1", "ok next net")
+        expect("key 1", "ok {")
+        # Nothing refused above was scored: the only point is that last one
+        reply = send("score")
+        if '"points":1,' not in reply:
+            failures.append("score after refused keys: %r" % reply)
+        expect("quit", "ok bye")
+
+        for msg in failures: print("FAIL " + msg)
+        print("%s: %d failure(s)" % (os.path.basename(sys.argv[0]), len(failures)))
+        return 1 if failures else 0
+    finally:
+        server.terminate()
+        server.wait()
+        shutil.rmtree(tmp, ignore_errors=True)
+
+if __name__ == "__main__":
+    sys.exit(main())